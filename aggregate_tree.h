@@ -0,0 +1,352 @@
+#ifndef AGGREGATE_TREE_H
+#define AGGREGATE_TREE_H
+
+#include <limits>
+#include <type_traits>
+#include "avlbst.h"
+
+/**
+* A node for an AggregateTree, which adds the summary of its subtree to an
+* AVLNode: the monoid's combine of the summaries of every item in it, in
+* key order.
+*/
+template <typename Key, typename Value, typename Summary>
+class AggregateNode : public AVLNode<Key, Value>{
+
+public:
+
+    // Constructor/destructor.
+    AggregateNode(const Key& key, const Value& value, AggregateNode<Key, Value, Summary>* parent);
+    AggregateNode(Key&& key, Value&& value, AggregateNode<Key, Value, Summary>* parent);
+    ~AggregateNode();
+
+    // Getter/setter for the summary of the node's subtree.
+    const Summary& getSummary() const;
+    void setSummary(const Summary& summary);
+
+    // Getters for parent, left, and right, hidden the same way AVLNode does.
+    AggregateNode<Key, Value, Summary>* getParent() const;
+    AggregateNode<Key, Value, Summary>* getLeft() const;
+    AggregateNode<Key, Value, Summary>* getRight() const;
+
+protected:
+    Summary summary_;
+};
+
+/*
+  -------------------------------------------------
+  Begin implementations for the AggregateNode class.
+  -------------------------------------------------
+*/
+
+/**
+* An explicit constructor. The summary is filled in by the tree once the
+* node is linked in.
+*/
+template<class Key, class Value, class Summary>
+AggregateNode<Key, Value, Summary>::AggregateNode(const Key& key, const Value& value,
+                                                  AggregateNode<Key, Value, Summary>* parent) :
+    AVLNode<Key, Value>(key, value, parent),
+    summary_(){
+
+}
+
+/**
+* An explicit constructor that moves the key and value into the node.
+*/
+template<class Key, class Value, class Summary>
+AggregateNode<Key, Value, Summary>::AggregateNode(Key&& key, Value&& value,
+                                                  AggregateNode<Key, Value, Summary>* parent) :
+    AVLNode<Key, Value>(std::move(key), std::move(value), parent),
+    summary_(){
+
+}
+
+/**
+* A destructor which does nothing.
+*/
+template<class Key, class Value, class Summary>
+AggregateNode<Key, Value, Summary>::~AggregateNode(){
+
+}
+
+/**
+* A getter for the summary of the subtree.
+*/
+template<class Key, class Value, class Summary>
+const Summary& AggregateNode<Key, Value, Summary>::getSummary() const{
+    return summary_;
+}
+
+/**
+* A setter for the summary of the subtree.
+*/
+template<class Key, class Value, class Summary>
+void AggregateNode<Key, Value, Summary>::setSummary(const Summary& summary){
+    summary_ = summary;
+}
+
+/**
+* Every node in an AggregateTree is an AggregateNode so the cast is always safe.
+*/
+template<class Key, class Value, class Summary>
+AggregateNode<Key, Value, Summary>* AggregateNode<Key, Value, Summary>::getParent() const{
+    return static_cast<AggregateNode<Key, Value, Summary>*>(Node<Key, Value>::getParent());
+}
+
+/**
+* Hidden for the same reasons as above.
+*/
+template<class Key, class Value, class Summary>
+AggregateNode<Key, Value, Summary>* AggregateNode<Key, Value, Summary>::getLeft() const{
+    return static_cast<AggregateNode<Key, Value, Summary>*>(this -> left_);
+}
+
+/**
+* Hidden for the same reasons as above.
+*/
+template<class Key, class Value, class Summary>
+AggregateNode<Key, Value, Summary>* AggregateNode<Key, Value, Summary>::getRight() const{
+    return static_cast<AggregateNode<Key, Value, Summary>*>(this -> right_);
+}
+
+/*
+  -----------------------------------------------
+  End implementations for the AggregateNode class.
+  -----------------------------------------------
+*/
+
+/**
+* Monoids for the common aggregates over the values. A monoid for an
+* AggregateTree has a value_type for the summaries and three members:
+* identity(), the summary of no items; lift(key, value), the summary of
+* one item; and combine(a, b), the summary of the items of a followed by
+* those of b, which must be associative (but need not be commutative).
+*/
+template <typename Key, typename Value>
+struct ValueSum{
+    typedef Value value_type;
+    value_type identity() const { return Value(); }
+    value_type lift(const Key& /*key*/, const Value& value) const { return value; }
+    value_type combine(const value_type& a, const value_type& b) const { return a + b; }
+};
+
+template <typename Key, typename Value>
+struct ValueMin{
+    typedef Value value_type;
+    value_type identity() const { return std::numeric_limits<Value>::max(); }
+    value_type lift(const Key& /*key*/, const Value& value) const { return value; }
+    value_type combine(const value_type& a, const value_type& b) const { return b < a ? b : a; }
+};
+
+template <typename Key, typename Value>
+struct ValueMax{
+    typedef Value value_type;
+    value_type identity() const { return std::numeric_limits<Value>::lowest(); }
+    value_type lift(const Key& /*key*/, const Value& value) const { return value; }
+    value_type combine(const value_type& a, const value_type& b) const { return a < b ? b : a; }
+};
+
+/**
+* An AVLTree that keeps, in every node, the summary of its subtree under a
+* user supplied Monoid (see ValueSum above for what a monoid provides).
+* The summaries are kept up to date through the augmentation hook of
+* AVLTree, so inserts, removes, rotations, bulk builds, split/join and
+* the set operations all maintain them, and aggregate(lo, hi) combines the
+* items of a key range in O(log n) without visiting them.
+*
+* Values must be changed through the tree (insert, insert_or_assign), not
+* by writing through an iterator, or the summaries above them go stale.
+*/
+template <class Key, class Value, class Monoid, class Compare = std::less<Key>, class Alloc = NodePool>
+class AggregateTree : public AVLTree<Key, Value, Compare, Alloc>{
+
+public:
+    typedef typename Monoid::value_type Summary;
+
+    explicit AggregateTree(const Compare& compare = Compare(), const Monoid& monoid = Monoid());
+    virtual ~AggregateTree();
+
+    Summary aggregate(const Key& lo, const Key& hi) const;
+    Summary total() const;
+
+protected:
+    typedef AggregateNode<Key, Value, Summary> NodeType;
+
+    virtual Node<Key, Value>* makeNode(Key&& key, Value&& value, Node<Key, Value>* parent);
+    virtual void destroyNode(Node<Key, Value>* current);
+    virtual void updateAugment(AVLNode<Key, Value>* current);
+    virtual bool trivialNodes() const;
+
+    Summary summaryOf(const NodeType* node) const;
+    Summary lift(const NodeType* node) const;
+    NodeType* getRoot() const;
+
+    Monoid monoid_;
+};
+
+/*
+  ----------------------------------------------------
+  Begin implementations for the AggregateTree class.
+  ----------------------------------------------------
+*/
+
+template<class Key, class Value, class Monoid, class Compare, class Alloc>
+AggregateTree<Key, Value, Monoid, Compare, Alloc>::AggregateTree(const Compare& compare, const Monoid& monoid) :
+    AVLTree<Key, Value, Compare, Alloc>(compare),
+    monoid_(monoid){
+    this -> augmented_ = true;
+}
+
+/**
+* Cleared here for the same reason AVLTree's destructor clears.
+*/
+template<class Key, class Value, class Monoid, class Compare, class Alloc>
+AggregateTree<Key, Value, Monoid, Compare, Alloc>::~AggregateTree(){
+    this -> clear();
+}
+
+/**
+* Returns the combined summary of the items with lo <= key < hi, in key
+* order. Walks down to the first node inside the range, then down each
+* side of it once, taking whole subtrees wherever they fall inside.
+*/
+template<class Key, class Value, class Monoid, class Compare, class Alloc>
+typename AggregateTree<Key, Value, Monoid, Compare, Alloc>::Summary
+AggregateTree<Key, Value, Monoid, Compare, Alloc>::aggregate(const Key& lo, const Key& hi) const{
+
+    if(!this -> compare_(lo, hi)){
+        return monoid_.identity();
+    }
+
+    //find the highest node with lo <= key < hi
+    NodeType* split = getRoot();
+    while(split != nullptr){
+        if(this -> compare_(split -> getKey(), lo)){
+            split = split -> getRight();
+        }
+        else if(!this -> compare_(split -> getKey(), hi)){
+            split = split -> getLeft();
+        }
+        else{
+            break;
+        }
+    }
+    if(split == nullptr){
+        return monoid_.identity();
+    }
+
+    //the items of the left subtree that are not less than lo
+    Summary left = monoid_.identity();
+    NodeType* current = split -> getLeft();
+    while(current != nullptr){
+        if(this -> compare_(current -> getKey(), lo)){
+            current = current -> getRight();
+        }
+        else{
+            Summary taken = monoid_.combine(lift(current), summaryOf(current -> getRight()));
+            left = monoid_.combine(taken, left);
+            current = current -> getLeft();
+        }
+    }
+
+    //the items of the right subtree that are less than hi
+    Summary right = monoid_.identity();
+    current = split -> getRight();
+    while(current != nullptr){
+        if(this -> compare_(current -> getKey(), hi)){
+            Summary taken = monoid_.combine(summaryOf(current -> getLeft()), lift(current));
+            right = monoid_.combine(right, taken);
+            current = current -> getRight();
+        }
+        else{
+            current = current -> getLeft();
+        }
+    }
+
+    return monoid_.combine(monoid_.combine(left, lift(split)), right);
+}
+
+/**
+* Returns the combined summary of every item in the tree, in O(1).
+*/
+template<class Key, class Value, class Monoid, class Compare, class Alloc>
+typename AggregateTree<Key, Value, Monoid, Compare, Alloc>::Summary
+AggregateTree<Key, Value, Monoid, Compare, Alloc>::total() const{
+    return summaryOf(getRoot());
+}
+
+/**
+* Creates an AggregateNode, moving the key and value in.
+*/
+template<class Key, class Value, class Monoid, class Compare, class Alloc>
+Node<Key, Value>* AggregateTree<Key, Value, Monoid, Compare, Alloc>::makeNode(Key&& key, Value&& value,
+                                                                    Node<Key, Value>* parent){
+    NodeType* node = this -> createNode(std::move(key), std::move(value), static_cast<NodeType*>(parent));
+    node -> setSummary(lift(node));
+    return node;
+}
+
+/**
+* Destroys a node as the AggregateNode it really is.
+*/
+template<class Key, class Value, class Monoid, class Compare, class Alloc>
+void AggregateTree<Key, Value, Monoid, Compare, Alloc>::destroyNode(Node<Key, Value>* current){
+    NodeType* node = static_cast<NodeType*>(current);
+    node -> ~NodeType();
+    this -> allocator_.deallocate(node);
+}
+
+/**
+* The summaries need destroying too if they are not trivial. The node
+* type itself never counts as trivial since its destructor is
+* user-provided, so the members are checked.
+*/
+template<class Key, class Value, class Monoid, class Compare, class Alloc>
+bool AggregateTree<Key, Value, Monoid, Compare, Alloc>::trivialNodes() const{
+    return std::is_trivially_destructible<std::pair<const Key, Value> >::value &&
+           std::is_trivially_destructible<Summary>::value;
+}
+
+/**
+* The summary of a subtree is the left summary, the node's own item and
+* the right summary, combined in that order.
+*/
+template<class Key, class Value, class Monoid, class Compare, class Alloc>
+void AggregateTree<Key, Value, Monoid, Compare, Alloc>::updateAugment(AVLNode<Key, Value>* current){
+    NodeType* node = static_cast<NodeType*>(current);
+    Summary left = monoid_.combine(summaryOf(node -> getLeft()), lift(node));
+    node -> setSummary(monoid_.combine(left, summaryOf(node -> getRight())));
+}
+
+/**
+* The summary of the subtree at node, which is the identity for NULL.
+*/
+template<class Key, class Value, class Monoid, class Compare, class Alloc>
+typename AggregateTree<Key, Value, Monoid, Compare, Alloc>::Summary
+AggregateTree<Key, Value, Monoid, Compare, Alloc>::summaryOf(const NodeType* node) const{
+    return node == nullptr ? monoid_.identity() : node -> getSummary();
+}
+
+/**
+* The summary of the item in node alone.
+*/
+template<class Key, class Value, class Monoid, class Compare, class Alloc>
+typename AggregateTree<Key, Value, Monoid, Compare, Alloc>::Summary
+AggregateTree<Key, Value, Monoid, Compare, Alloc>::lift(const NodeType* node) const{
+    return monoid_.lift(node -> getKey(), node -> getValue());
+}
+
+template<class Key, class Value, class Monoid, class Compare, class Alloc>
+typename AggregateTree<Key, Value, Monoid, Compare, Alloc>::NodeType*
+AggregateTree<Key, Value, Monoid, Compare, Alloc>::getRoot() const{
+    return static_cast<NodeType*>(this -> root_);
+}
+
+/*
+  --------------------------------------------------
+  End implementations for the AggregateTree class.
+  --------------------------------------------------
+*/
+
+#endif
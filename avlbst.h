@@ -5,14 +5,19 @@
 #include <exception>
 #include <cstdlib>
 #include <algorithm>
+#include <future>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+#include <typeinfo>
 #include "bst.h"
 
 struct KeyError { };
 
 /**
-* A special kind of node for an AVL tree, which adds the balance as a data member, plus
-* other additional helper functions. You do NOT need to implement any functionality or
-* add additional data members or helper functions.
+* A special kind of node for an AVL tree, which adds the balance, plus other additional
+* helper functions. The balance is always -1, 0 or 1, so it is kept in the tag bits of the
+* parent pointer (see Node in bst.h) and an AVLNode is no bigger than a Node.
 */
 template <typename Key, typename Value>
 class AVLNode : public Node<Key, Value>{
@@ -21,23 +26,21 @@ public:
 
     // Constructor/destructor.
     AVLNode(const Key& key, const Value& value, AVLNode<Key, Value>* parent);
-    virtual ~AVLNode();
+    AVLNode(Key&& key, Value&& value, AVLNode<Key, Value>* parent);
+    ~AVLNode();
 
     // Getter/setter for the node's height.
     char getBalance () const;
     void setBalance (char balance);
     void updateBalance(char diff);
 
-    // Getters for parent, left, and right. These need to be redefined since they
-    // return pointers to AVLNodes - not plain Nodes. See the Node class in bst.h
-    // for more information.
-    virtual AVLNode<Key, Value>* getParent() const override;
-    virtual AVLNode<Key, Value>* getLeft() const override;
-    virtual AVLNode<Key, Value>* getRight() const override;
-
-protected:
-
-    char balance_;
+    // Getters for parent, left, and right. These hide the ones in Node since they
+    // return pointers to AVLNodes - not plain Nodes. They are not virtual, so the
+    // cast is resolved at compile time. See the Node class in bst.h for more
+    // information.
+    AVLNode<Key, Value>* getParent() const;
+    AVLNode<Key, Value>* getLeft() const;
+    AVLNode<Key, Value>* getRight() const;
 };
 
 /*
@@ -52,8 +55,17 @@ protected:
 */
 template<class Key, class Value>
 AVLNode<Key, Value>::AVLNode(const Key& key, const Value& value, AVLNode<Key, Value> *parent) :
-    Node<Key, Value>(key, value, parent), balance_(0){
+    Node<Key, Value>(key, value, parent){
+    setBalance(0);
+}
 
+/**
+* An explicit constructor that moves the key and value into the node.
+*/
+template<class Key, class Value>
+AVLNode<Key, Value>::AVLNode(Key&& key, Value&& value, AVLNode<Key, Value> *parent) :
+    Node<Key, Value>(std::move(key), std::move(value), parent){
+    setBalance(0);
 }
 
 /**
@@ -69,36 +81,36 @@ AVLNode<Key, Value>::~AVLNode(){
 */
 template<class Key, class Value>
 char AVLNode<Key, Value>::getBalance() const{
-    return balance_;
+    return static_cast<char>(this->getTag()) - 1;
 }
 
 /**
-* A setter for the balance of a AVLNode.
+* A setter for the balance of a AVLNode. The balance must be -1, 0 or 1.
 */
 template<class Key, class Value>
 void AVLNode<Key, Value>::setBalance(char balance){
-    balance_ = balance;
+    this->setTag(static_cast<unsigned>(balance + 1));
 }
 
 /**
-* Adds diff to the balance of a AVLNode.
+* Adds diff to the balance of a AVLNode. The result must be -1, 0 or 1.
 */
 template<class Key, class Value>
 void AVLNode<Key, Value>::updateBalance(char diff){
-    balance_ += diff;
+    setBalance(getBalance() + diff);
 }
 
 /**
-* An overridden function for getting the parent since a static_cast is necessary to make sure
-* that our node is a AVLNode.
+* A getter for the parent that hides the one in Node, since a static_cast is necessary to make sure
+* that our node is a AVLNode. Every node in an AVLTree is an AVLNode so the cast is always safe.
 */
 template<class Key, class Value>
 AVLNode<Key, Value> *AVLNode<Key, Value>::getParent() const{
-    return static_cast<AVLNode<Key, Value>*>(this->parent_);
+    return static_cast<AVLNode<Key, Value>*>(Node<Key, Value>::getParent());
 }
 
 /**
-* Overridden for the same reasons as above.
+* Hidden for the same reasons as above.
 */
 template<class Key, class Value>
 AVLNode<Key, Value> *AVLNode<Key, Value>::getLeft() const{
@@ -106,7 +118,7 @@ AVLNode<Key, Value> *AVLNode<Key, Value>::getLeft() const{
 }
 
 /**
-* Overridden for the same reasons as above.
+* Hidden for the same reasons as above.
 */
 template<class Key, class Value>
 AVLNode<Key, Value> *AVLNode<Key, Value>::getRight() const{
@@ -121,18 +133,43 @@ AVLNode<Key, Value> *AVLNode<Key, Value>::getRight() const{
 */
 
 
-template <class Key, class Value>
-class AVLTree : public BinarySearchTree<Key, Value>{
+template <class Key, class Value, class Compare = std::less<Key>, class Alloc = NodePool>
+class AVLTree : public BinarySearchTree<Key, Value, Compare, Alloc>{
 
 public:
 
-    virtual void insert (const std::pair<const Key, Value> &new_item); // TODO
+    explicit AVLTree(const Compare& compare = Compare());
+    virtual ~AVLTree();
     virtual void remove(const Key& key);  // TODO
+    void split(const Key& key, AVLTree& right);
+    void join(const std::pair<const Key, Value>& pivot, AVLTree& right);
+    void join(AVLTree& right);
+    void eraseRange(const Key& lo, const Key& hi);
+
+    // Set operations that take the nodes of other, leaving it empty.
+    // The two halves of every level run in parallel on big enough trees.
+    void unionWith(AVLTree& other);
+    void intersectWith(AVLTree& other);
+    void differenceWith(AVLTree& other);
 
 protected:
 
+    virtual Node<Key, Value>* makeNode(Key&& key, Value&& value, Node<Key, Value>* parent);
+    virtual void linkNode(Node<Key, Value>* node, Node<Key, Value>* parent, bool left);
+    virtual void destroyNode(Node<Key, Value>* current);
+    virtual void finishBuiltNode(Node<Key, Value>* current, int left_height, int right_height);
+    virtual const char* checkNode(Node<Key, Value>* current, int left_height, int right_height) const;
+
     virtual void nodeSwap( AVLNode<Key,Value>* n1, AVLNode<Key,Value>* n2);
 
+    // Augmentation hook. A tree whose nodes carry data computed from their
+    // subtrees (a size, an aggregate) sets augmented_ and overrides
+    // updateAugment to recompute that data for one node from its children.
+    // The tree calls it on every node whose subtree changes, bottom up.
+    virtual void updateAugment(AVLNode<Key,Value>* current);
+    void updateAugmentPath(AVLNode<Key,Value>* current);
+    virtual void valueChanged(Node<Key, Value>* current);
+
     // Add helper functions here
     void rotateLeft(AVLNode<Key,Value>* node);
     void rotateRight(AVLNode<Key,Value>* node);
@@ -141,129 +178,150 @@ protected:
     void insert_fix(AVLNode<Key,Value>* parent, AVLNode<Key,Value>* node);
     void remove_fix(AVLNode<Key,Value>* node, char diff);
     static AVLNode<Key,Value>* get_taller_child(AVLNode<Key,Value>* current);
+
+    // split/join helpers, which work on heights worked out from the balances
+    int getTreeHeight() const;
+    void checkSameType(const AVLTree& other) const;
+    static int leftHeight(AVLNode<Key,Value>* current, int height);
+    static int rightHeight(AVLNode<Key,Value>* current, int height);
+    int setChildHeights(AVLNode<Key,Value>* current, int left_height, int right_height);
+    AVLNode<Key,Value>* join3(AVLNode<Key,Value>* left, int left_height, AVLNode<Key,Value>* pivot,
+                              AVLNode<Key,Value>* right, int right_height, int& height);
+    AVLNode<Key,Value>* joinRight(AVLNode<Key,Value>* left, int left_height, AVLNode<Key,Value>* pivot,
+                                  AVLNode<Key,Value>* right, int right_height, int& height);
+    AVLNode<Key,Value>* joinLeft(AVLNode<Key,Value>* left, int left_height, AVLNode<Key,Value>* pivot,
+                                 AVLNode<Key,Value>* right, int right_height, int& height);
+    void split_helper(AVLNode<Key,Value>* current, int height, const Key& key,
+                      AVLNode<Key,Value>*& left, int& left_height,
+                      AVLNode<Key,Value>*& right, int& right_height,
+                      AVLNode<Key,Value>** found = nullptr);
+    AVLNode<Key,Value>* splitLast(AVLNode<Key,Value>* current, int height,
+                                  AVLNode<Key,Value>*& rest, int& rest_height);
+    AVLNode<Key,Value>* join2(AVLNode<Key,Value>* left, int left_height,
+                              AVLNode<Key,Value>* right, int right_height, int& height);
+
+    // set operation helpers
+    enum SetOperation { SET_UNION, SET_INTERSECTION, SET_DIFFERENCE };
+
+    // subtrees left over by a set operation, chained through their parent
+    // pointers, to be destroyed once the parallel part is done
+    struct NodeList{
+        AVLNode<Key,Value>* head;
+        AVLNode<Key,Value>* tail;
+    };
+
+    // only levels with both subtrees at least this tall run in parallel
+    static const int PARALLEL_HEIGHT = 14;
+
+    void setOperation(AVLTree& other, SetOperation operation);
+    AVLNode<Key,Value>* setOperationHelper(AVLNode<Key,Value>* a, int a_height,
+                                           AVLNode<Key,Value>* b, int b_height,
+                                           SetOperation operation, int parallel_depth,
+                                           int& height, NodeList& discarded);
+    static void discard(NodeList& list, AVLNode<Key,Value>* subtree);
+    static void appendList(NodeList& list, const NodeList& more);
+
+    bool augmented_;
 };
 
-template<class Key, class Value>
-void AVLTree<Key, Value>::insert(const std::pair<const Key, Value> &new_item){
-    
-    Key new_key = new_item.first;
-    Value new_value = new_item.second;
+/**
+* Constructor that passes the comparison object to the BinarySearchTree.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+AVLTree<Key, Value, Compare, Alloc>::AVLTree(const Compare& compare) :
+    BinarySearchTree<Key, Value, Compare, Alloc>(compare),
+    augmented_(false){
 
-    //start at the root
-    AVLNode<Key, Value>* current = static_cast<AVLNode<Key,Value>*>(this -> root_);
+}
 
-    //if tree is empty
-    if(current == nullptr){
-        AVLNode<Key, Value>* new_node = new AVLNode<Key, Value>(new_key, new_value, current);
-        new_node -> setBalance(0);
-        BinarySearchTree<Key,Value>::root_ = new_node;
-        return;
-    }
+/**
+* The base destructor can only reach Node's destructor, so the
+* nodes are cleared here while destroyNode still sees AVLNodes.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+AVLTree<Key, Value, Compare, Alloc>::~AVLTree(){
+    this -> clear();
+}
 
-    bool node_inserted = false;
-    bool left_child = false;
-    bool right_child = false;
+/**
+* Creates an AVLNode, moving the key and value in.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+Node<Key, Value>* AVLTree<Key, Value, Compare, Alloc>::makeNode(Key&& key, Value&& value,
+                                                      Node<Key, Value>* parent){
+    return this -> createNode(std::move(key), std::move(value),
+                              static_cast<AVLNode<Key, Value>*>(parent));
+}
 
-    //walk the tree
-    while(node_inserted == false){
-        //get the current node's key and compare with the key 
-        //that we're trying to insert
-        Key current_key = current -> getKey();
+/**
+* Attaches a new node the same way the BinarySearchTree does, then
+* updates the balances of its ancestors. Every kind of insert ends up
+* here, so this is where the AVL insert algorithm lives.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+void AVLTree<Key, Value, Compare, Alloc>::linkNode(Node<Key, Value>* node,
+                                         Node<Key, Value>* parent_node, bool left){
 
-        //if the current key is equal
-        if(current_key == new_key){
-            current -> setValue(new_value);
-            node_inserted = true;
-            return;
-        }
-        //if less than, go let
-        else if(new_key < current_key){
-            //if there's an empty spot
-            if(BinarySearchTree<Key,Value>::hasLeftChild(current) == false){
-                AVLNode<Key, Value>* new_node = new AVLNode<Key, Value>(new_key, new_value, current);
-                new_node -> setBalance(0);
-                current -> setLeft(new_node);
-                node_inserted = true;
-                left_child = true;
-            }
-            else{
-                current = current -> getLeft();
-            }
-        }
-        //if greater than, go right
-        else if(new_key > current_key){
-            //if there's an empty spot
-            if(BinarySearchTree<Key,Value>::hasRightChild(current) == false){
-                AVLNode<Key, Value>* new_node = new AVLNode<Key, Value>(new_key, new_value, current);
-                new_node -> setBalance(0);
-                current -> setRight(new_node);
-                node_inserted = true;
-                right_child = true;
-            }
-            else{
-                current = current -> getRight();
-            }
-        }
+    BinarySearchTree<Key, Value, Compare, Alloc>::linkNode(node, parent_node, left);
+
+    //if the tree was empty there is nothing to update
+    if(parent_node == nullptr){
+        return;
     }
 
     //update ancestor's balances
-    //in the while loop above, I use current to find the parent so 
-    //current is still a pointer to the inserted node's parent
-    AVLNode<Key, Value>* parent = current;
+    AVLNode<Key, Value>* parent = static_cast<AVLNode<Key, Value>*>(parent_node);
+    AVLNode<Key, Value>* inserted_node = static_cast<AVLNode<Key, Value>*>(node);
+    if(augmented_){
+        updateAugmentPath(parent);
+    }
     char parent_balance = parent -> getBalance();
 
     if(parent_balance == -1 || parent_balance == 1){
         parent -> setBalance(0);
     }
     else if(parent_balance == 0){
-
-        AVLNode<Key, Value>* inserted_node = nullptr;
-        if(left_child){
-            inserted_node = parent -> getLeft();
-        }
-        else if(right_child){
-            inserted_node = parent -> getRight();
-        }
-
-        if(BinarySearchTree<Key, Value>::isLeftChild(inserted_node,parent)){
+        if(left){
             parent -> setBalance(-1);
         }
-        else if(BinarySearchTree<Key, Value>::isRightChild(inserted_node,parent)){
+        else{
             parent -> setBalance(1);
         }
         insert_fix(parent, inserted_node);
     }
-    return;
 }
 
-template<class Key, class Value>
-void AVLTree<Key, Value>::insert_fix(AVLNode<Key,Value>* parent, 
+template<class Key, class Value, class Compare, class Alloc>
+void AVLTree<Key, Value, Compare, Alloc>::insert_fix(AVLNode<Key,Value>* parent, 
                                         AVLNode<Key,Value>* node){
 
     //if p is null or parent(p) is null, return
-    if(parent == nullptr || BinarySearchTree<Key, Value>::isRoot(parent)){
+    if(parent == nullptr || BinarySearchTree<Key, Value, Compare, Alloc>::isRoot(parent)){
         return;
     }
 
     AVLNode<Key,Value>* grandparent = parent -> getParent();
 
-    if(BinarySearchTree<Key, Value>::isLeftChild(parent, grandparent)){
+    if(BinarySearchTree<Key, Value, Compare, Alloc>::isLeftChild(parent, grandparent)){
 
-        grandparent -> updateBalance(-1);
-        char g_balance = grandparent -> getBalance();
+        //the balance only ever holds -1, 0 or 1, so the new
+        //balance is worked out here and case 3 never stores it
+        char g_balance = grandparent -> getBalance() + (-1);
 
         //Case 1
         if(g_balance == 0){
+            grandparent -> setBalance(0);
             return;
         }
         //Case 2
         else if(g_balance == -1){
+            grandparent -> setBalance(-1);
             insert_fix(grandparent, parent);
         }
         //Case 3
         else if(g_balance == -2){
             //if zig-zig
-            if(BinarySearchTree<Key, Value>::isLeftChild(node, parent)){
+            if(BinarySearchTree<Key, Value, Compare, Alloc>::isLeftChild(node, parent)){
                 rotateRight(grandparent);
                 grandparent -> setBalance(0);
                 parent -> setBalance(0);
@@ -295,23 +353,26 @@ void AVLTree<Key, Value>::insert_fix(AVLNode<Key,Value>* parent,
             }
         }
     }
-    else if(BinarySearchTree<Key, Value>::isRightChild(parent, grandparent)){
+    else if(BinarySearchTree<Key, Value, Compare, Alloc>::isRightChild(parent, grandparent)){
 
-        grandparent -> updateBalance(1);
-        char g_balance = grandparent -> getBalance();
+        //the balance only ever holds -1, 0 or 1, so the new
+        //balance is worked out here and case 3 never stores it
+        char g_balance = grandparent -> getBalance() + (1);
 
         //Case 1
         if(g_balance == 0){
+            grandparent -> setBalance(0);
             return;
         }
         //Case 2
         else if(g_balance == 1){
+            grandparent -> setBalance(1);
             insert_fix(grandparent, parent);
         }
         //Case 3
         else if(g_balance == 2){
             //if zig-zig
-            if(BinarySearchTree<Key, Value>::isRightChild(node, parent)){
+            if(BinarySearchTree<Key, Value, Compare, Alloc>::isRightChild(node, parent)){
                 rotateLeft(grandparent);
                 grandparent -> setBalance(0);
                 parent -> setBalance(0);
@@ -346,11 +407,11 @@ void AVLTree<Key, Value>::insert_fix(AVLNode<Key,Value>* parent,
     return;
 }
 
-template<class Key, class Value>
-void AVLTree<Key, Value>:: remove(const Key& key){
+template<class Key, class Value, class Compare, class Alloc>
+void AVLTree<Key, Value, Compare, Alloc>:: remove(const Key& key){
     
     //find the node to remove
-    Node<Key, Value>* found_node = BinarySearchTree<Key,Value>::internalFind(key);
+    Node<Key, Value>* found_node = BinarySearchTree<Key,Value,Compare,Alloc>::internalFind(key);
 
     //cast the found node to an AVLNode
     //did this in one line before but this way is easier
@@ -367,38 +428,38 @@ void AVLTree<Key, Value>:: remove(const Key& key){
     //calculate balance changes
     //calculating the balance change has to be before
     //you delete the node
-    if(BinarySearchTree<Key,Value>::isRoot(node_to_remove) == false){
-        if(BinarySearchTree<Key,Value>::isLeftChild(node_to_remove, parent)){
+    if(BinarySearchTree<Key,Value,Compare,Alloc>::isRoot(node_to_remove) == false){
+        if(BinarySearchTree<Key,Value,Compare,Alloc>::isLeftChild(node_to_remove, parent)){
             diff = 1;
         }
-        else if(BinarySearchTree<Key,Value>::isRightChild(node_to_remove, parent)){
+        else if(BinarySearchTree<Key,Value,Compare,Alloc>::isRightChild(node_to_remove, parent)){
             diff = -1;
         }
     }
 
     //if node has no children
-    if(BinarySearchTree<Key,Value>::isLeaf(node_to_remove)){
+    if(BinarySearchTree<Key,Value,Compare,Alloc>::isLeaf(node_to_remove)){
         //fix where root points
-        if(BinarySearchTree<Key,Value>::isRoot(node_to_remove)){
-            BinarySearchTree<Key,Value>::root_ = nullptr;
+        if(BinarySearchTree<Key,Value,Compare,Alloc>::isRoot(node_to_remove)){
+            BinarySearchTree<Key,Value,Compare,Alloc>::root_ = nullptr;
         }
         else{
             //fix the parent's pointers
-            if(BinarySearchTree<Key,Value>::isLeftChild(node_to_remove, parent)){
+            if(BinarySearchTree<Key,Value,Compare,Alloc>::isLeftChild(node_to_remove, parent)){
                 parent -> setLeft(nullptr);
             }
-            else if(BinarySearchTree<Key,Value>::isRightChild(node_to_remove, parent)){
+            else if(BinarySearchTree<Key,Value,Compare,Alloc>::isRightChild(node_to_remove, parent)){
                 parent -> setRight(nullptr);
             }
         }
     }
 
     //if node has one child
-    else if(BinarySearchTree<Key,Value>::hasOneChild(node_to_remove)){
+    else if(BinarySearchTree<Key,Value,Compare,Alloc>::hasOneChild(node_to_remove)){
 
         //get pointer to child
         Node<Key, Value>* child = nullptr;
-        if(BinarySearchTree<Key,Value>::hasLeftChild(node_to_remove)){
+        if(BinarySearchTree<Key,Value,Compare,Alloc>::hasLeftChild(node_to_remove)){
             child = node_to_remove -> getLeft();
         }
         else{
@@ -407,16 +468,16 @@ void AVLTree<Key, Value>:: remove(const Key& key){
 
         //promote the child
         //if node_to_remove is root
-        if(BinarySearchTree<Key,Value>::isRoot(node_to_remove)){
+        if(BinarySearchTree<Key,Value,Compare,Alloc>::isRoot(node_to_remove)){
             child -> setParent(parent);
-            BinarySearchTree<Key,Value>::root_ = child;
+            BinarySearchTree<Key,Value,Compare,Alloc>::root_ = child;
         }
         else{
             //fix the parent's pointers
-            if(BinarySearchTree<Key,Value>::isLeftChild(node_to_remove, parent)){
+            if(BinarySearchTree<Key,Value,Compare,Alloc>::isLeftChild(node_to_remove, parent)){
                 parent -> setLeft(child);
             }
-            else if(BinarySearchTree<Key,Value>::isRightChild(node_to_remove, parent)){
+            else if(BinarySearchTree<Key,Value,Compare,Alloc>::isRightChild(node_to_remove, parent)){
                 parent -> setRight(child);
             }
             child -> setParent(parent);
@@ -424,17 +485,17 @@ void AVLTree<Key, Value>:: remove(const Key& key){
     }
 
     //if node has two children
-    else if(BinarySearchTree<Key,Value>::hasTwoChildren(node_to_remove)){
+    else if(BinarySearchTree<Key,Value,Compare,Alloc>::hasTwoChildren(node_to_remove)){
         //find predecessor
-        Node<Key, Value>* find = BinarySearchTree<Key,Value>::predecessor(node_to_remove);
+        Node<Key, Value>* find = BinarySearchTree<Key,Value,Compare,Alloc>::predecessor(node_to_remove);
         AVLNode<Key, Value>* pred = static_cast<AVLNode<Key,Value>*>(find);
 
         //swap node_to_remove with predecessor
         nodeSwap(node_to_remove, pred);
 
         //check if pred is now root
-        if(BinarySearchTree<Key,Value>::isRoot(pred)){
-            BinarySearchTree<Key,Value>::root_ = pred;
+        if(BinarySearchTree<Key,Value,Compare,Alloc>::isRoot(pred)){
+            BinarySearchTree<Key,Value,Compare,Alloc>::root_ = pred;
         }
 
         //node_to_remove is now where its predecesspr was
@@ -445,54 +506,60 @@ void AVLTree<Key, Value>:: remove(const Key& key){
         parent = node_to_remove -> getParent();
 
         //update balances
-        if(BinarySearchTree<Key,Value>::isLeftChild(node_to_remove, parent)){
+        if(BinarySearchTree<Key,Value,Compare,Alloc>::isLeftChild(node_to_remove, parent)){
             diff = 1;
         }
-        else if(BinarySearchTree<Key,Value>::isRightChild(node_to_remove, parent)){
+        else if(BinarySearchTree<Key,Value,Compare,Alloc>::isRightChild(node_to_remove, parent)){
             diff = -1;
         }
 
         //if no children
-        if(BinarySearchTree<Key,Value>::isLeaf(node_to_remove)){
+        if(BinarySearchTree<Key,Value,Compare,Alloc>::isLeaf(node_to_remove)){
             AVLNode <Key,Value>* new_parent = node_to_remove -> getParent();
-            if(BinarySearchTree<Key,Value>::isLeftChild(node_to_remove, new_parent)){
+            if(BinarySearchTree<Key,Value,Compare,Alloc>::isLeftChild(node_to_remove, new_parent)){
                 new_parent -> setLeft(nullptr);
             }
-            else if(BinarySearchTree<Key,Value>::isRightChild(node_to_remove, new_parent)){
+            else if(BinarySearchTree<Key,Value,Compare,Alloc>::isRightChild(node_to_remove, new_parent)){
                 new_parent -> setRight(nullptr);
             }
         }
         //if one child
-        else if(BinarySearchTree<Key,Value>::hasOneChild(node_to_remove)){
+        else if(BinarySearchTree<Key,Value,Compare,Alloc>::hasOneChild(node_to_remove)){
             AVLNode<Key, Value>* current_node = node_to_remove;
             AVLNode<Key, Value>* current_parent = current_node -> getParent();
             AVLNode<Key, Value>* current_child = nullptr;
-            if(BinarySearchTree<Key,Value>::hasLeftChild(current_node)){
+            if(BinarySearchTree<Key,Value,Compare,Alloc>::hasLeftChild(current_node)){
                 current_child = current_node -> getLeft();
             }
             else{
                 current_child = current_node -> getRight();
             }
 
-            if(BinarySearchTree<Key,Value>::isLeftChild(current_node, current_parent)){
+            if(BinarySearchTree<Key,Value,Compare,Alloc>::isLeftChild(current_node, current_parent)){
                 current_parent -> setLeft(current_child);
             }
-            else if(BinarySearchTree<Key,Value>::isRightChild(current_node, current_parent)){
+            else if(BinarySearchTree<Key,Value,Compare,Alloc>::isRightChild(current_node, current_parent)){
                 current_parent -> setRight(current_child);
             }
             current_child -> setParent(current_parent);
         }
     }
 
-    delete node_to_remove;
+    this -> unthread(node_to_remove);
+    destroyNode(node_to_remove);
+
+    //every node whose subtree lost the node is on the path up from parent
+    if(augmented_){
+        updateAugmentPath(parent);
+    }
 
     //patch the balances of the tree
     remove_fix(parent, diff);
     return;
 }
 
-template<class Key, class Value>
-void AVLTree<Key, Value>::remove_fix(AVLNode<Key,Value>* node, char diff){
+template<class Key, class Value, class Compare, class Alloc>
+void AVLTree<Key, Value, Compare, Alloc>::remove_fix(AVLNode<Key,Value>* node, char diff){
 
     //if n is null, return
     if(node == nullptr){
@@ -501,11 +568,11 @@ void AVLTree<Key, Value>::remove_fix(AVLNode<Key,Value>* node, char diff){
     //Compute next recursive call's arguments before altering the tree
     AVLNode<Key,Value>* parent = node -> getParent();
     char next_diff = 0;
-    if(BinarySearchTree<Key,Value>::isRoot(node) == false){
-        if(BinarySearchTree<Key,Value>::isLeftChild(node, parent)){
+    if(BinarySearchTree<Key,Value,Compare,Alloc>::isRoot(node) == false){
+        if(BinarySearchTree<Key,Value,Compare,Alloc>::isLeftChild(node, parent)){
             next_diff = 1;
         }
-        else if(BinarySearchTree<Key,Value>::isRightChild(node, parent)){
+        else if(BinarySearchTree<Key,Value,Compare,Alloc>::isRightChild(node, parent)){
             next_diff = -1;
         }
     }
@@ -650,21 +717,90 @@ void AVLTree<Key, Value>::remove_fix(AVLNode<Key,Value>* node, char diff){
     }
 }
 
-template<class Key, class Value>
-void AVLTree<Key, Value>::nodeSwap( AVLNode<Key,Value>* n1, AVLNode<Key,Value>* n2){
-    BinarySearchTree<Key, Value>::nodeSwap(n1, n2);
+/**
+* Destroys a node as the AVLNode it really is.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+void AVLTree<Key, Value, Compare, Alloc>::destroyNode(Node<Key, Value>* current){
+    AVLNode<Key, Value>* node = static_cast<AVLNode<Key, Value>*>(current);
+    node -> ~AVLNode();
+    this -> allocator_.deallocate(node);
+}
+
+/**
+* Sets the balance of a node made by assignSorted from the heights of
+* its subtrees, which never differ by more than one.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+void AVLTree<Key, Value, Compare, Alloc>::finishBuiltNode(Node<Key, Value>* current,
+                                                int left_height, int right_height){
+    AVLNode<Key, Value>* node = static_cast<AVLNode<Key, Value>*>(current);
+    node -> setBalance(static_cast<char>(right_height - left_height));
+    if(augmented_){
+        updateAugment(node);
+    }
+}
+
+/**
+* The stored balance of every node must match the heights of its
+* subtrees, which also keeps them within one of each other.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+const char* AVLTree<Key, Value, Compare, Alloc>::checkNode(Node<Key, Value>* current,
+                                                int left_height, int right_height) const{
+    AVLNode<Key, Value>* node = static_cast<AVLNode<Key, Value>*>(current);
+    if(node -> getBalance() != right_height - left_height){
+        return "a stored AVL balance does not match the subtree heights";
+    }
+    return nullptr;
+}
+
+/**
+* Recomputes the augmented data of current from its children. A plain
+* AVLTree has none.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+void AVLTree<Key, Value, Compare, Alloc>::updateAugment(AVLNode<Key,Value>* /*current*/){
+
+}
+
+/**
+* Augmented data may depend on the values, so a new value is treated like
+* a change to the subtrees of every node above it.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+void AVLTree<Key, Value, Compare, Alloc>::valueChanged(Node<Key, Value>* current){
+    if(augmented_){
+        updateAugmentPath(static_cast<AVLNode<Key,Value>*>(current));
+    }
+}
+
+/**
+* Calls updateAugment on current and each of its ancestors, bottom up.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+void AVLTree<Key, Value, Compare, Alloc>::updateAugmentPath(AVLNode<Key,Value>* current){
+    while(current != nullptr){
+        updateAugment(current);
+        current = current -> getParent();
+    }
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+void AVLTree<Key, Value, Compare, Alloc>::nodeSwap( AVLNode<Key,Value>* n1, AVLNode<Key,Value>* n2){
+    BinarySearchTree<Key, Value, Compare, Alloc>::nodeSwap(n1, n2);
     char tempB = n1->getBalance();
     n1->setBalance(n2->getBalance());
     n2->setBalance(tempB);
 }
 
-template<class Key, class Value>
-void AVLTree<Key, Value>::rotateLeft(AVLNode<Key,Value>* node){
+template<class Key, class Value, class Compare, class Alloc>
+void AVLTree<Key, Value, Compare, Alloc>::rotateLeft(AVLNode<Key,Value>* node){
 
-    if(BinarySearchTree<Key,Value>::isLeaf(node)){
+    if(BinarySearchTree<Key,Value,Compare,Alloc>::isLeaf(node)){
         return;
     }
-    if(BinarySearchTree<Key,Value>::hasRightChild(node) == false){
+    if(BinarySearchTree<Key,Value,Compare,Alloc>::hasRightChild(node) == false){
         return;
     }
 
@@ -679,16 +815,18 @@ void AVLTree<Key, Value>::rotateLeft(AVLNode<Key,Value>* node){
     //first pair is the original parent and the child 
     //of the current node
     //if current is the root, the parent is nullptr
-    if(BinarySearchTree<Key,Value>::isRoot(current) == false){
-        if(BinarySearchTree<Key,Value>::isLeftChild(current,parent)){
+    //a node with no parent that is not the root heads a detached
+    //subtree in split/join, and root_ must be left alone for those
+    if(BinarySearchTree<Key,Value,Compare,Alloc>::isRoot(current) == false){
+        if(BinarySearchTree<Key,Value,Compare,Alloc>::isLeftChild(current,parent)){
             parent -> setLeft(child);
         }
-        else if(BinarySearchTree<Key,Value>::isRightChild(current,parent)){
+        else if(BinarySearchTree<Key,Value,Compare,Alloc>::isRightChild(current,parent)){
             parent -> setRight(child);
         }
     }
-    else{
-        BinarySearchTree<Key,Value>::root_ = child;
+    else if(BinarySearchTree<Key,Value,Compare,Alloc>::root_ == current){
+        BinarySearchTree<Key,Value,Compare,Alloc>::root_ = child;
     }
     child -> setParent(parent);
 
@@ -701,16 +839,22 @@ void AVLTree<Key, Value>::rotateLeft(AVLNode<Key,Value>* node){
     if(childs_leftchild != nullptr){
         childs_leftchild -> setParent(current);
     }
+
+    //current is now below child
+    if(augmented_){
+        updateAugment(current);
+        updateAugment(child);
+    }
 }
 
 
-template<class Key, class Value>
-void AVLTree<Key, Value>::rotateRight(AVLNode<Key,Value>* node){
+template<class Key, class Value, class Compare, class Alloc>
+void AVLTree<Key, Value, Compare, Alloc>::rotateRight(AVLNode<Key,Value>* node){
 
-    if(BinarySearchTree<Key,Value>::isLeaf(node)){
+    if(BinarySearchTree<Key,Value,Compare,Alloc>::isLeaf(node)){
         return;
     }
-    if(BinarySearchTree<Key,Value>::hasLeftChild(node) == false){
+    if(BinarySearchTree<Key,Value,Compare,Alloc>::hasLeftChild(node) == false){
         return;
     }
 
@@ -725,16 +869,18 @@ void AVLTree<Key, Value>::rotateRight(AVLNode<Key,Value>* node){
     //first pair is the original parent and the child 
     //of the current node
     //if current is the root, the parent is nullptr
-    if(BinarySearchTree<Key,Value>::isRoot(current) == false){
-        if(BinarySearchTree<Key,Value>::isLeftChild(current,parent)){
+    //a node with no parent that is not the root heads a detached
+    //subtree in split/join, and root_ must be left alone for those
+    if(BinarySearchTree<Key,Value,Compare,Alloc>::isRoot(current) == false){
+        if(BinarySearchTree<Key,Value,Compare,Alloc>::isLeftChild(current,parent)){
             parent -> setLeft(child);
         }
-        else if(BinarySearchTree<Key,Value>::isRightChild(current,parent)){
+        else if(BinarySearchTree<Key,Value,Compare,Alloc>::isRightChild(current,parent)){
             parent -> setRight(child);
         }
     }
-    else{
-        BinarySearchTree<Key,Value>::root_ = child;
+    else if(BinarySearchTree<Key,Value,Compare,Alloc>::root_ == current){
+        BinarySearchTree<Key,Value,Compare,Alloc>::root_ = child;
     }
     child -> setParent(parent);
 
@@ -747,31 +893,769 @@ void AVLTree<Key, Value>::rotateRight(AVLNode<Key,Value>* node){
     if(childs_rightchild != nullptr){
         childs_rightchild -> setParent(current);
     }
+
+    //current is now below child
+    if(augmented_){
+        updateAugment(current);
+        updateAugment(child);
+    }
+}
+
+
+/**
+* Moves every item with a key not less than key into right, leaving the
+* smaller ones in this tree. Whatever right held before is cleared. Runs in
+* O(log n): the nodes are relinked, never copied or reallocated, and right
+* keeps this tree's node memory alive for as long as it needs it.
+* right must be the same type of tree as this one.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+void AVLTree<Key, Value, Compare, Alloc>::split(const Key& key, AVLTree& right){
+
+    if(&right == this){
+        throw std::invalid_argument("cannot split an AVLTree into itself");
+    }
+    checkSameType(right);
+    right.clear();
+    right.compare_ = this -> compare_;
+    right.allocator_.share(this -> allocator_);
+
+    AVLNode<Key,Value>* root = static_cast<AVLNode<Key,Value>*>(this -> root_);
+    AVLNode<Key,Value>* left_root = nullptr;
+    AVLNode<Key,Value>* right_root = nullptr;
+    int left_height = 0;
+    int right_height = 0;
+    split_helper(root, getTreeHeight(), key, left_root, left_height, right_root, right_height);
+
+    this -> root_ = left_root;
+    right.root_ = right_root;
+    if(this -> threaded_){
+        this -> threadNodes(BinarySearchTree<Key,Value,Compare,Alloc>::getLargestNodeSubtree(left_root), nullptr);
+        this -> threadNodes(nullptr, right.getSmallestNode());
+    }
 }
 
+/**
+* Appends pivot and then every item of right to this tree, leaving right
+* empty. Every key in this tree must be less than pivot's, and pivot's
+* must be less than every key in right; otherwise std::invalid_argument is
+* thrown and neither tree changes. Runs in O(log n) and moves the nodes of
+* right over without copying them, so right must be the same type of tree
+* as this one.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+void AVLTree<Key, Value, Compare, Alloc>::join(const std::pair<const Key, Value>& pivot, AVLTree& right){
+
+    if(&right == this){
+        throw std::invalid_argument("cannot join an AVLTree with itself");
+    }
+    checkSameType(right);
+    Node<Key, Value>* largest = BinarySearchTree<Key,Value,Compare,Alloc>::getLargestNodeSubtree(this -> root_);
+    Node<Key, Value>* smallest = right.getSmallestNode();
+    if((largest != nullptr && !this -> compare_(largest -> getKey(), pivot.first)) ||
+       (smallest != nullptr && !this -> compare_(pivot.first, smallest -> getKey()))){
+        throw std::invalid_argument("joined AVLTrees must be ordered and must not overlap");
+    }
+
+    AVLNode<Key,Value>* node = static_cast<AVLNode<Key,Value>*>(
+        makeNode(Key(pivot.first), Value(pivot.second), nullptr));
+    this -> allocator_.share(right.allocator_);
+
+    if(this -> threaded_){
+        this -> threadNodes(largest, node);
+        this -> threadNodes(node, smallest);
+    }
+
+    int height = 0;
+    this -> root_ = join3(static_cast<AVLNode<Key,Value>*>(this -> root_), getTreeHeight(), node,
+                          static_cast<AVLNode<Key,Value>*>(right.root_), right.getTreeHeight(), height);
+    right.root_ = nullptr;
+}
+
+/**
+* Appends every item of right to this tree, leaving right empty. Every key
+* in this tree must be less than every key in right. The smallest item of
+* right is taken out and used as the pivot of the join above.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+void AVLTree<Key, Value, Compare, Alloc>::join(AVLTree& right){
+
+    checkSameType(right);
+    Node<Key, Value>* smallest = right.getSmallestNode();
+    if(smallest == nullptr){
+        return;
+    }
+    Node<Key, Value>* largest = BinarySearchTree<Key,Value,Compare,Alloc>::getLargestNodeSubtree(this -> root_);
+    if(&right == this ||
+       (largest != nullptr && !this -> compare_(largest -> getKey(), smallest -> getKey()))){
+        throw std::invalid_argument("joined AVLTrees must be ordered and must not overlap");
+    }
+
+    std::pair<const Key, Value> pivot(smallest -> getItem());
+    right.remove(pivot.first);
+    join(pivot, right);
+}
+
+/**
+* Removes every item with lo <= key < hi. The range is cut out with two
+* splits, the rest is put back together with one join, and the cut out
+* nodes are destroyed in one walk, so this is O(log n + k) for k removed
+* items instead of k separate removes.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+void AVLTree<Key, Value, Compare, Alloc>::eraseRange(const Key& lo, const Key& hi){
+
+    if(!this -> compare_(lo, hi) || this -> root_ == nullptr){
+        return;
+    }
+
+    AVLNode<Key,Value>* root = static_cast<AVLNode<Key,Value>*>(this -> root_);
+    int height = getTreeHeight();
+    this -> root_ = nullptr;
+
+    AVLNode<Key,Value>* left = nullptr;
+    AVLNode<Key,Value>* rest = nullptr;
+    AVLNode<Key,Value>* middle = nullptr;
+    AVLNode<Key,Value>* right = nullptr;
+    int left_height = 0;
+    int rest_height = 0;
+    int middle_height = 0;
+    int right_height = 0;
+    split_helper(root, height, lo, left, left_height, rest, rest_height);
+    split_helper(rest, rest_height, hi, middle, middle_height, right, right_height);
+
+    if(this -> threaded_){
+        this -> threadNodes(BinarySearchTree<Key,Value,Compare,Alloc>::getLargestNodeSubtree(left),
+                            BinarySearchTree<Key,Value,Compare,Alloc>::getSmallestNodeSubtree(right));
+    }
+    this -> root_ = join2(left, left_height, right, right_height, height);
+    this -> clear_helper(middle);
+}
+
+/**
+* Throws std::invalid_argument unless other is the same type of tree as
+* this one. Moving nodes between trees is only safe if both make, augment
+* and destroy their nodes the same way; a plain AVLTree joined into an
+* OrderStatisticsTree would leave nodes without sizes behind, to be freed
+* later as the wrong type.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+void AVLTree<Key, Value, Compare, Alloc>::checkSameType(const AVLTree& other) const{
+    if(typeid(*this) != typeid(other)){
+        throw std::invalid_argument("cannot move nodes between different types of AVLTree");
+    }
+}
+
+/**
+* The height of the tree, found by walking down the taller side of every
+* node. O(log n).
+*/
+template<class Key, class Value, class Compare, class Alloc>
+int AVLTree<Key, Value, Compare, Alloc>::getTreeHeight() const{
+    int height = 0;
+    AVLNode<Key,Value>* current = static_cast<AVLNode<Key,Value>*>(this -> root_);
+    while(current != nullptr){
+        ++height;
+        if(current -> getBalance() < 0){
+            current = current -> getLeft();
+        }
+        else{
+            current = current -> getRight();
+        }
+    }
+    return height;
+}
+
+/**
+* The height of the left subtree of a node of the given height.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+int AVLTree<Key, Value, Compare, Alloc>::leftHeight(AVLNode<Key,Value>* current, int height){
+    return current -> getBalance() > 0 ? height - 2 : height - 1;
+}
+
+/**
+* The height of the right subtree of a node of the given height.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+int AVLTree<Key, Value, Compare, Alloc>::rightHeight(AVLNode<Key,Value>* current, int height){
+    return current -> getBalance() < 0 ? height - 2 : height - 1;
+}
+
+/**
+* Sets the balance of a node from the heights of its subtrees, which must
+* differ by at most one, and returns the node's height. The node has just
+* been given new children, so its augmented data is brought up to date.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+int AVLTree<Key, Value, Compare, Alloc>::setChildHeights(AVLNode<Key,Value>* current,
+                                                int left_height, int right_height){
+    current -> setBalance(static_cast<char>(right_height - left_height));
+    if(augmented_){
+        updateAugment(current);
+    }
+    return std::max(left_height, right_height) + 1;
+}
+
+/**
+* Joins the subtrees left and right, which have no parent, with pivot
+* between them, and returns the root of the result, with no parent, and
+* its height. Every key in left must be less than pivot's and every key in
+* right greater. O(|left_height - right_height| + 1).
+*/
+template<class Key, class Value, class Compare, class Alloc>
+AVLNode<Key,Value>* AVLTree<Key, Value, Compare, Alloc>::join3(AVLNode<Key,Value>* left, int left_height,
+                                                     AVLNode<Key,Value>* pivot,
+                                                     AVLNode<Key,Value>* right, int right_height,
+                                                     int& height){
+    AVLNode<Key,Value>* root = nullptr;
+    if(left_height > right_height + 1){
+        root = joinRight(left, left_height, pivot, right, right_height, height);
+    }
+    else if(right_height > left_height + 1){
+        root = joinLeft(left, left_height, pivot, right, right_height, height);
+    }
+    else{
+        pivot -> setLeft(left);
+        pivot -> setRight(right);
+        if(left != nullptr){
+            left -> setParent(pivot);
+        }
+        if(right != nullptr){
+            right -> setParent(pivot);
+        }
+        height = setChildHeights(pivot, left_height, right_height);
+        root = pivot;
+    }
+    root -> setParent(nullptr);
+    return root;
+}
+
+/**
+* The case of join3 where left is more than one level taller: walks down
+* the right spine of left to a subtree about as tall as right, hangs pivot
+* there with that subtree and right below it, and rotates on the way back
+* up wherever a node ends up two levels heavier on the right.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+AVLNode<Key,Value>* AVLTree<Key, Value, Compare, Alloc>::joinRight(AVLNode<Key,Value>* left, int left_height,
+                                                         AVLNode<Key,Value>* pivot,
+                                                         AVLNode<Key,Value>* right, int right_height,
+                                                         int& height){
+    int outer_height = leftHeight(left, left_height);
+    AVLNode<Key,Value>* inner = left -> getRight();
+    int inner_height = rightHeight(left, left_height);
+
+    //join pivot and right with the right subtree of left
+    AVLNode<Key,Value>* joined = nullptr;
+    int joined_height = 0;
+    if(inner_height <= right_height + 1){
+        pivot -> setLeft(inner);
+        pivot -> setRight(right);
+        if(inner != nullptr){
+            inner -> setParent(pivot);
+        }
+        if(right != nullptr){
+            right -> setParent(pivot);
+        }
+        joined = pivot;
+        joined_height = setChildHeights(pivot, inner_height, right_height);
+    }
+    else{
+        joined = joinRight(inner, inner_height, pivot, right, right_height, joined_height);
+    }
+    left -> setRight(joined);
+    joined -> setParent(left);
+
+    if(joined_height <= outer_height + 1){
+        height = setChildHeights(left, outer_height, joined_height);
+        return left;
+    }
+
+    //left is now two levels heavier on the right
+    AVLNode<Key,Value>* middle = joined -> getLeft();
+    int middle_height = leftHeight(joined, joined_height);
+    int far_height = rightHeight(joined, joined_height);
+    if(far_height >= middle_height){
+        rotateLeft(left);
+        int lower = setChildHeights(left, outer_height, middle_height);
+        height = setChildHeights(joined, lower, far_height);
+        return joined;
+    }
+    int middle_left = leftHeight(middle, middle_height);
+    int middle_right = rightHeight(middle, middle_height);
+    rotateRight(joined);
+    rotateLeft(left);
+    int lower_left = setChildHeights(left, outer_height, middle_left);
+    int lower_right = setChildHeights(joined, middle_right, far_height);
+    height = setChildHeights(middle, lower_left, lower_right);
+    return middle;
+}
+
+/**
+* The mirror image of joinRight, for when right is more than one level
+* taller than left.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+AVLNode<Key,Value>* AVLTree<Key, Value, Compare, Alloc>::joinLeft(AVLNode<Key,Value>* left, int left_height,
+                                                        AVLNode<Key,Value>* pivot,
+                                                        AVLNode<Key,Value>* right, int right_height,
+                                                        int& height){
+    int outer_height = rightHeight(right, right_height);
+    AVLNode<Key,Value>* inner = right -> getLeft();
+    int inner_height = leftHeight(right, right_height);
+
+    //join left and pivot with the left subtree of right
+    AVLNode<Key,Value>* joined = nullptr;
+    int joined_height = 0;
+    if(inner_height <= left_height + 1){
+        pivot -> setLeft(left);
+        pivot -> setRight(inner);
+        if(left != nullptr){
+            left -> setParent(pivot);
+        }
+        if(inner != nullptr){
+            inner -> setParent(pivot);
+        }
+        joined = pivot;
+        joined_height = setChildHeights(pivot, left_height, inner_height);
+    }
+    else{
+        joined = joinLeft(left, left_height, pivot, inner, inner_height, joined_height);
+    }
+    right -> setLeft(joined);
+    joined -> setParent(right);
+
+    if(joined_height <= outer_height + 1){
+        height = setChildHeights(right, joined_height, outer_height);
+        return right;
+    }
+
+    //right is now two levels heavier on the left
+    AVLNode<Key,Value>* middle = joined -> getRight();
+    int middle_height = rightHeight(joined, joined_height);
+    int far_height = leftHeight(joined, joined_height);
+    if(far_height >= middle_height){
+        rotateRight(right);
+        int lower = setChildHeights(right, middle_height, outer_height);
+        height = setChildHeights(joined, far_height, lower);
+        return joined;
+    }
+    int middle_left = leftHeight(middle, middle_height);
+    int middle_right = rightHeight(middle, middle_height);
+    rotateLeft(joined);
+    rotateRight(right);
+    int lower_left = setChildHeights(joined, far_height, middle_left);
+    int lower_right = setChildHeights(right, middle_right, outer_height);
+    height = setChildHeights(middle, lower_left, lower_right);
+    return middle;
+}
+
+/**
+* Splits the subtree at current, of the given height, into the nodes with
+* keys less than key (left) and the rest (right), each a valid AVL subtree
+* with no parent. Every level joins the node and its subtree on one side
+* onto the result from the level below, and those joins cost O(log n) in
+* total since the heights involved only grow on the way back up.
+* If found is not NULL, a node with a key equal to key is not put in right
+* but stored, detached, in *found (which is NULL if there is none).
+*/
+template<class Key, class Value, class Compare, class Alloc>
+void AVLTree<Key, Value, Compare, Alloc>::split_helper(AVLNode<Key,Value>* current, int height, const Key& key,
+                                             AVLNode<Key,Value>*& left, int& left_height,
+                                             AVLNode<Key,Value>*& right, int& right_height,
+                                             AVLNode<Key,Value>** found){
+    if(current == nullptr){
+        left = nullptr;
+        right = nullptr;
+        left_height = 0;
+        right_height = 0;
+        if(found != nullptr){
+            *found = nullptr;
+        }
+        return;
+    }
+
+    //detach current from its children
+    AVLNode<Key,Value>* current_left = current -> getLeft();
+    AVLNode<Key,Value>* current_right = current -> getRight();
+    int current_left_height = leftHeight(current, height);
+    int current_right_height = rightHeight(current, height);
+    if(current_left != nullptr){
+        current_left -> setParent(nullptr);
+    }
+    if(current_right != nullptr){
+        current_right -> setParent(nullptr);
+    }
+    current -> setParent(nullptr);
+
+    if(this -> compare_(current -> getKey(), key)){
+        AVLNode<Key,Value>* lower = nullptr;
+        int lower_height = 0;
+        split_helper(current_right, current_right_height, key, lower, lower_height, right, right_height, found);
+        left = join3(current_left, current_left_height, current, lower, lower_height, left_height);
+    }
+    else if(found != nullptr && !this -> compare_(key, current -> getKey())){
+        current -> setLeft(nullptr);
+        current -> setRight(nullptr);
+        *found = current;
+        left = current_left;
+        left_height = current_left_height;
+        right = current_right;
+        right_height = current_right_height;
+    }
+    else{
+        AVLNode<Key,Value>* upper = nullptr;
+        int upper_height = 0;
+        split_helper(current_left, current_left_height, key, left, left_height, upper, upper_height, found);
+        right = join3(upper, upper_height, current, current_right, current_right_height, right_height);
+    }
+}
+
+/**
+* Takes the node with the largest key out of the subtree at current, of
+* the given height, and returns it detached. rest and rest_height are set
+* to what is left, with no parent. O(log n).
+*/
+template<class Key, class Value, class Compare, class Alloc>
+AVLNode<Key,Value>* AVLTree<Key, Value, Compare, Alloc>::splitLast(AVLNode<Key,Value>* current, int height,
+                                                         AVLNode<Key,Value>*& rest, int& rest_height){
+    AVLNode<Key,Value>* current_left = current -> getLeft();
+    AVLNode<Key,Value>* current_right = current -> getRight();
+    int current_left_height = leftHeight(current, height);
+    int current_right_height = rightHeight(current, height);
+    if(current_left != nullptr){
+        current_left -> setParent(nullptr);
+    }
+    if(current_right != nullptr){
+        current_right -> setParent(nullptr);
+    }
+    current -> setParent(nullptr);
+
+    if(current_right == nullptr){
+        current -> setLeft(nullptr);
+        rest = current_left;
+        rest_height = current_left_height;
+        return current;
+    }
+
+    AVLNode<Key,Value>* lower = nullptr;
+    int lower_height = 0;
+    AVLNode<Key,Value>* last = splitLast(current_right, current_right_height, lower, lower_height);
+    rest = join3(current_left, current_left_height, current, lower, lower_height, rest_height);
+    return last;
+}
+
+/**
+* Joins two detached subtrees, every key in left being less than every
+* key in right, using the largest node of left as the pivot.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+AVLNode<Key,Value>* AVLTree<Key, Value, Compare, Alloc>::join2(AVLNode<Key,Value>* left, int left_height,
+                                                     AVLNode<Key,Value>* right, int right_height,
+                                                     int& height){
+    if(left == nullptr){
+        height = right_height;
+        return right;
+    }
+    if(right == nullptr){
+        height = left_height;
+        return left;
+    }
+    AVLNode<Key,Value>* rest = nullptr;
+    int rest_height = 0;
+    AVLNode<Key,Value>* pivot = splitLast(left, left_height, rest, rest_height);
+    return join3(rest, rest_height, pivot, right, right_height, height);
+}
+
+/**
+* Adds every item of other to this tree, leaving other empty. For a key in
+* both trees the value from other wins, as it would with insert. Nodes are
+* moved over from other, never copied.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+void AVLTree<Key, Value, Compare, Alloc>::unionWith(AVLTree& other){
+    setOperation(other, SET_UNION);
+}
+
+/**
+* Removes every item whose key is not also in other, leaving other empty.
+* The values from this tree are kept.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+void AVLTree<Key, Value, Compare, Alloc>::intersectWith(AVLTree& other){
+    setOperation(other, SET_INTERSECTION);
+}
+
+/**
+* Removes every item whose key is in other, leaving other empty.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+void AVLTree<Key, Value, Compare, Alloc>::differenceWith(AVLTree& other){
+    setOperation(other, SET_DIFFERENCE);
+}
+
+/**
+* The body of the three set operations. The nodes of both trees are
+* detached from their roots, recombined by setOperationHelper, and the
+* ones left over are destroyed afterwards on this thread, since the
+* allocator is not safe to use from several threads at once. Nothing is
+* allocated while the helpers run, and the comparator is called from
+* several threads at once, so it must not modify shared state. other
+* must be the same type of tree as this one.
+* If the comparator throws, the nodes of both trees are destroyed, leaving
+* both empty, and the exception is rethrown once every thread is done.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+void AVLTree<Key, Value, Compare, Alloc>::setOperation(AVLTree& other, SetOperation operation){
+
+    if(&other == this){
+        if(operation == SET_DIFFERENCE){
+            this -> clear();
+        }
+        return;
+    }
+    checkSameType(other);
+    this -> allocator_.share(other.allocator_);
+
+    //enough levels of parallel halves to keep every core busy
+    int parallel_depth = 2;
+    for(unsigned threads = std::thread::hardware_concurrency(); threads > 1; threads /= 2){
+        ++parallel_depth;
+    }
+
+    AVLNode<Key,Value>* a = static_cast<AVLNode<Key,Value>*>(this -> root_);
+    AVLNode<Key,Value>* b = static_cast<AVLNode<Key,Value>*>(other.root_);
+    int a_height = getTreeHeight();
+    int b_height = other.getTreeHeight();
+    this -> root_ = nullptr;
+    other.root_ = nullptr;
+
+    NodeList discarded = { nullptr, nullptr };
+    int height = 0;
+    std::exception_ptr failure;
+    try{
+        this -> root_ = setOperationHelper(a, a_height, b, b_height, operation, parallel_depth, height, discarded);
+    }
+    catch(...){
+        //every node is on discarded by now
+        failure = std::current_exception();
+    }
+
+    while(discarded.head != nullptr){
+        AVLNode<Key,Value>* next = discarded.head -> getParent();
+        this -> clear_helper(discarded.head);
+        discarded.head = next;
+    }
+
+    //the surviving nodes of both trees are interleaved, so relink them all
+    this -> rethread();
+    if(failure){
+        std::rethrow_exception(failure);
+    }
+}
+
+/**
+* Combines the detached subtrees a and b and returns the result, with no
+* parent, and its height. Nodes that do not make it into the result are
+* added to discarded. Splits a at the root key of b, recurses on the two
+* halves, and joins the results back around b's root (or drops it), for
+* O(m log(n/m + 1)) work on trees of sizes m <= n. While parallel_depth
+* is positive and both subtrees are tall enough the two halves run at the
+* same time, the left one on a new thread.
+* If the comparator throws, every node of a and b is added to discarded
+* before the exception leaves. The comparator is only called by
+* split_helper, which has joined nothing yet when it throws, so a is still
+* whole then, if with stale parent pointers.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+AVLNode<Key,Value>* AVLTree<Key, Value, Compare, Alloc>::setOperationHelper(AVLNode<Key,Value>* a, int a_height,
+                                                                  AVLNode<Key,Value>* b, int b_height,
+                                                                  SetOperation operation, int parallel_depth,
+                                                                  int& height, NodeList& discarded){
+    if(a == nullptr || b == nullptr){
+        AVLNode<Key,Value>* kept = operation == SET_UNION ? (a != nullptr ? a : b) :
+                                   operation == SET_DIFFERENCE ? a : nullptr;
+        AVLNode<Key,Value>* dropped = kept == a ? b : a;
+        if(dropped != nullptr){
+            discard(discarded, dropped);
+        }
+        height = kept == nullptr ? 0 : (kept == a ? a_height : b_height);
+        return kept;
+    }
+
+    //take the root of b apart
+    AVLNode<Key,Value>* b_left = b -> getLeft();
+    AVLNode<Key,Value>* b_right = b -> getRight();
+    int b_left_height = leftHeight(b, b_height);
+    int b_right_height = rightHeight(b, b_height);
+    if(b_left != nullptr){
+        b_left -> setParent(nullptr);
+    }
+    if(b_right != nullptr){
+        b_right -> setParent(nullptr);
+    }
+    b -> setLeft(nullptr);
+    b -> setRight(nullptr);
+
+    AVLNode<Key,Value>* a_left = nullptr;
+    AVLNode<Key,Value>* a_right = nullptr;
+    AVLNode<Key,Value>* found = nullptr;
+    int a_left_height = 0;
+    int a_right_height = 0;
+    try{
+        split_helper(a, a_height, b -> getKey(), a_left, a_left_height, a_right, a_right_height, &found);
+    }
+    catch(...){
+        discard(discarded, a);
+        discard(discarded, b);
+        if(b_left != nullptr){
+            discard(discarded, b_left);
+        }
+        if(b_right != nullptr){
+            discard(discarded, b_right);
+        }
+        throw;
+    }
+
+    //recurse on both halves
+    AVLNode<Key,Value>* left = nullptr;
+    AVLNode<Key,Value>* right = nullptr;
+    int left_height = 0;
+    int right_height = 0;
+    NodeList left_discarded = { nullptr, nullptr };
+    std::exception_ptr left_failure;
+    std::exception_ptr right_failure;
+    auto left_half = [&](){
+        try{
+            left = setOperationHelper(a_left, a_left_height, b_left, b_left_height, operation,
+                                      parallel_depth - 1, left_height, left_discarded);
+        }
+        catch(...){
+            left_failure = std::current_exception();
+        }
+    };
+    auto right_half = [&](){
+        try{
+            right = setOperationHelper(a_right, a_right_height, b_right, b_right_height, operation,
+                                       parallel_depth - 1, right_height, discarded);
+        }
+        catch(...){
+            right_failure = std::current_exception();
+        }
+    };
+
+    std::future<void> pending;
+    if(parallel_depth > 0 && std::min(a_height, b_height) >= PARALLEL_HEIGHT){
+        try{
+            pending = std::async(std::launch::async, left_half);
+        }
+        catch(const std::system_error&){
+            //no thread to be had, do it here instead
+        }
+    }
+    if(!pending.valid()){
+        left_half();
+    }
+    right_half();
+    if(pending.valid()){
+        pending.get();
+    }
+    appendList(discarded, left_discarded);
+
+    if(left_failure || right_failure){
+        //the half that failed discarded its own nodes, the rest are here
+        if(left != nullptr){
+            discard(discarded, left);
+        }
+        if(right != nullptr){
+            discard(discarded, right);
+        }
+        discard(discarded, b);
+        if(found != nullptr){
+            discard(discarded, found);
+        }
+        std::rethrow_exception(left_failure ? left_failure : right_failure);
+    }
+
+    //put the halves back together
+    AVLNode<Key,Value>* pivot = nullptr;
+    if(operation == SET_UNION){
+        pivot = b;
+        if(found != nullptr){
+            discard(discarded, found);
+        }
+    }
+    else{
+        discard(discarded, b);
+        if(operation == SET_INTERSECTION){
+            pivot = found;
+        }
+        else if(found != nullptr){
+            discard(discarded, found);
+        }
+    }
+
+    if(pivot != nullptr){
+        return join3(left, left_height, pivot, right, right_height, height);
+    }
+    return join2(left, left_height, right, right_height, height);
+}
+
+/**
+* Adds a detached subtree to a list of subtrees to destroy.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+void AVLTree<Key, Value, Compare, Alloc>::discard(NodeList& list, AVLNode<Key,Value>* subtree){
+    subtree -> setParent(nullptr);
+    if(list.tail == nullptr){
+        list.head = subtree;
+    }
+    else{
+        list.tail -> setParent(subtree);
+    }
+    list.tail = subtree;
+}
+
+/**
+* Moves the subtrees of more onto the end of list.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+void AVLTree<Key, Value, Compare, Alloc>::appendList(NodeList& list, const NodeList& more){
+    if(more.head == nullptr){
+        return;
+    }
+    if(list.tail == nullptr){
+        list.head = more.head;
+    }
+    else{
+        list.tail -> setParent(more.head);
+    }
+    list.tail = more.tail;
+}
 
 //wrote a function to find the taller child of a given node
 //ended up not using this function
-template<typename Key, typename Value>
-AVLNode<Key, Value>* AVLTree<Key, Value>::get_taller_child(AVLNode<Key, Value>* current){
+template<typename Key, typename Value, typename Compare, typename Alloc>
+AVLNode<Key, Value>* AVLTree<Key, Value, Compare, Alloc>::get_taller_child(AVLNode<Key, Value>* current){
 
     AVLNode<Key, Value>* temp = nullptr;
     if(current == nullptr){
         return temp;
     }
 
-    if(BinarySearchTree<Key,Value>::hasChildren(current) == false){
+    if(BinarySearchTree<Key,Value,Compare,Alloc>::hasChildren(current) == false){
         return temp;
     }
-    else if(BinarySearchTree<Key,Value>::hasOneChild(current)){
-        if(BinarySearchTree<Key,Value>::hasLeftChild(current)){
+    else if(BinarySearchTree<Key,Value,Compare,Alloc>::hasOneChild(current)){
+        if(BinarySearchTree<Key,Value,Compare,Alloc>::hasLeftChild(current)){
             temp = current -> getLeft();
         }
-        else if(BinarySearchTree<Key,Value>::hasRightChild(current)){
+        else if(BinarySearchTree<Key,Value,Compare,Alloc>::hasRightChild(current)){
             temp = current -> getRight();
         }
     }
-    else if(BinarySearchTree<Key,Value>::hasTwoChildren(current)){
+    else if(BinarySearchTree<Key,Value,Compare,Alloc>::hasTwoChildren(current)){
         char l_height = current -> getLeft() -> getBalance();
         char r_height = current -> getRight() -> getBalance();
         int left_height = l_height;
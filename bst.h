@@ -3,23 +3,41 @@
 
 #include <iostream>
 #include <exception>
+#include <stdexcept>
 #include <cstdlib>
 #include <utility>
 #include <algorithm>
+#include <functional>
+#include <type_traits>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <vector>
+#include "node_pool.h"
+#include "frozen_tree.h"
 
 /**
  * A templated class for a Node in a search tree.
- * The getters for parent/left/right are virtual so
- * that they can be overridden for future kinds of
- * search trees, such as Red Black trees, Splay trees,
- * and AVL trees.
+ * Nothing in a node is virtual, so nodes carry no vtable
+ * pointer and walking the tree is a plain pointer load.
+ * Node types for other kinds of search trees, such as
+ * AVL trees, derive from this class and hide the getters
+ * for parent/left/right with versions returning their own
+ * type. Trees destroy their nodes through destroyNode,
+ * which knows the real node type.
+ *
+ * Nodes are always at least 4-byte aligned, so the two low
+ * bits of the parent pointer are free. They hold a small tag
+ * that derived nodes can use (AVLNode keeps its balance there)
+ * and are masked off by getParent.
  */
 template <typename Key, typename Value>
 class Node{
 
 public:
     Node(const Key& key, const Value& value, Node<Key, Value>* parent);
-    virtual ~Node();
+    Node(Key&& key, Value&& value, Node<Key, Value>* parent);
+    ~Node();
 
     const std::pair<const Key, Value>& getItem() const;
     std::pair<const Key, Value>& getItem();
@@ -27,18 +45,24 @@ public:
     const Value& getValue() const;
     Value& getValue();
 
-    virtual Node<Key, Value>* getParent() const;
-    virtual Node<Key, Value>* getLeft() const;
-    virtual Node<Key, Value>* getRight() const;
+    Node<Key, Value>* getParent() const;
+    Node<Key, Value>* getLeft() const;
+    Node<Key, Value>* getRight() const;
 
     void setParent(Node<Key, Value>* parent);
     void setLeft(Node<Key, Value>* left);
     void setRight(Node<Key, Value>* right);
     void setValue(const Value &value);
+    void setValue(Value&& value);
 
 protected:
+    static const std::uintptr_t TAG_MASK = 3;
+
+    unsigned getTag() const;
+    void setTag(unsigned tag);
+
     std::pair<const Key, Value> item_;
-    Node<Key, Value>* parent_;
+    std::uintptr_t parent_;
     Node<Key, Value>* left_;
     Node<Key, Value>* right_;
 
@@ -56,7 +80,19 @@ protected:
 template<typename Key, typename Value>
 Node<Key, Value>::Node(const Key& key, const Value& value, Node<Key, Value>* parent) :
     item_(key, value),
-    parent_(parent),
+    parent_(reinterpret_cast<std::uintptr_t>(parent)),
+    left_(NULL),
+    right_(NULL){
+    static_assert(alignof(Node<Key, Value>) > TAG_MASK, "node alignment leaves no room for the tag");
+}
+
+/**
+* Explicit constructor for a node that moves the key and value into it.
+*/
+template<typename Key, typename Value>
+Node<Key, Value>::Node(Key&& key, Value&& value, Node<Key, Value>* parent) :
+    item_(std::move(key), std::move(value)),
+    parent_(reinterpret_cast<std::uintptr_t>(parent)),
     left_(NULL),
     right_(NULL){
 }
@@ -112,15 +148,15 @@ Value& Node<Key, Value>::getValue(){
 }
 
 /**
-* An implementation of the virtual function for retreiving the parent.
+* A getter for the parent of a node.
 */
 template<typename Key, typename Value>
 Node<Key, Value>* Node<Key, Value>::getParent() const{
-    return parent_;
+    return reinterpret_cast<Node<Key, Value>*>(parent_ & ~TAG_MASK);
 }
 
 /**
-* An implementation of the virtual function for retreiving the left child.
+* A getter for the left child of a node.
 */
 template<typename Key, typename Value>
 Node<Key, Value>* Node<Key, Value>::getLeft() const{
@@ -128,7 +164,7 @@ Node<Key, Value>* Node<Key, Value>::getLeft() const{
 }
 
 /**
-* An implementation of the virtual function for retreiving the right child.
+* A getter for the right child of a node.
 */
 template<typename Key, typename Value>
 Node<Key, Value>* Node<Key, Value>::getRight() const{
@@ -136,11 +172,11 @@ Node<Key, Value>* Node<Key, Value>::getRight() const{
 }
 
 /**
-* A setter for setting the parent of a node.
+* A setter for setting the parent of a node. The tag stays with the node.
 */
 template<typename Key, typename Value>
 void Node<Key, Value>::setParent(Node<Key, Value>* parent){
-    parent_ = parent;
+    parent_ = reinterpret_cast<std::uintptr_t>(parent) | (parent_ & TAG_MASK);
 }
 
 /**
@@ -167,6 +203,30 @@ void Node<Key, Value>::setValue(const Value& value){
     item_.second = value;
 }
 
+/**
+* A setter for the value of a node that moves the value in.
+*/
+template<typename Key, typename Value>
+void Node<Key, Value>::setValue(Value&& value){
+    item_.second = std::move(value);
+}
+
+/**
+* A getter for the tag stored in the low bits of the parent pointer.
+*/
+template<typename Key, typename Value>
+unsigned Node<Key, Value>::getTag() const{
+    return static_cast<unsigned>(parent_ & TAG_MASK);
+}
+
+/**
+* A setter for the tag stored in the low bits of the parent pointer.
+*/
+template<typename Key, typename Value>
+void Node<Key, Value>::setTag(unsigned tag){
+    parent_ = (parent_ & ~TAG_MASK) | (static_cast<std::uintptr_t>(tag) & TAG_MASK);
+}
+
 /*
   ---------------------------------------
   End implementations for the Node class.
@@ -175,22 +235,33 @@ void Node<Key, Value>::setValue(const Value& value){
 
 /**
 * A templated unbalanced binary search tree.
+* Keys are ordered by Compare, a strict weak ordering like the one
+* std::map takes. Two keys are equal when neither is less than the other.
+* Nodes are allocated through Alloc, which defaults to a per-tree NodePool.
 */
-template <typename Key, typename Value>
+template <typename Key, typename Value, typename Compare = std::less<Key>, typename Alloc = NodePool>
 class BinarySearchTree{
 
 public:
-    BinarySearchTree(); 
+    explicit BinarySearchTree(const Compare& compare = Compare()); 
     virtual ~BinarySearchTree(); 
     virtual void insert(const std::pair<const Key, Value>& keyValuePair); 
+    void insert(std::pair<const Key, Value>&& keyValuePair);
     virtual void remove(const Key& key); 
     void clear(); 
+    template<typename InputIt>
+    void assignSorted(InputIt first, InputIt last);
+    template<typename InputIt>
+    void insertBatch(InputIt first, InputIt last);
+    FrozenTree<Key, Value, Compare> freeze() const;
     bool isBalanced() const; 
+    struct TreeStats;
+    TreeStats validate() const;
     void print() const;
     bool empty() const;
 
-    template<typename PPKey, typename PPValue>
-    friend void prettyPrintBST(BinarySearchTree<PPKey, PPValue> & tree);
+    template<typename PPKey, typename PPValue, typename PPCompare, typename PPAlloc>
+    friend void prettyPrintBST(BinarySearchTree<PPKey, PPValue, PPCompare, PPAlloc> & tree);
 
 public:
     /**
@@ -199,6 +270,12 @@ public:
     class iterator{   
     
     public:
+        typedef std::bidirectional_iterator_tag iterator_category;
+        typedef std::pair<const Key, Value> value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef std::pair<const Key, Value>* pointer;
+        typedef std::pair<const Key, Value>& reference;
+
         iterator();
 
         std::pair<const Key,Value>& operator*() const;
@@ -208,21 +285,206 @@ public:
         bool operator!=(const iterator& rhs) const;
 
         iterator& operator++();
+        iterator operator++(int);
+        iterator& operator--();
+        iterator operator--(int);
 
     protected:
-        friend class BinarySearchTree<Key, Value>;
-        iterator(Node<Key,Value>* ptr);
+        friend class BinarySearchTree<Key, Value, Compare, Alloc>;
+        iterator(Node<Key,Value>* ptr, const BinarySearchTree<Key, Value, Compare, Alloc>* tree);
         Node<Key, Value> *current_;
+        // the tree iterated over, so that end() can step back to the largest item
+        const BinarySearchTree<Key, Value, Compare, Alloc>* tree_;
+    };
+
+    /**
+    * The same as iterator, but the items cannot be changed through it.
+    * Any iterator converts to a const_iterator.
+    */
+    class const_iterator{
+
+    public:
+        typedef std::bidirectional_iterator_tag iterator_category;
+        typedef std::pair<const Key, Value> value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const std::pair<const Key, Value>* pointer;
+        typedef const std::pair<const Key, Value>& reference;
+
+        const_iterator();
+        const_iterator(const iterator& it);
+
+        const std::pair<const Key,Value>& operator*() const;
+        const std::pair<const Key,Value>* operator->() const;
+
+        // friends so that an iterator on either side converts
+        friend bool operator==(const const_iterator& lhs, const const_iterator& rhs){
+            return lhs.it_ == rhs.it_;
+        }
+        friend bool operator!=(const const_iterator& lhs, const const_iterator& rhs){
+            return lhs.it_ != rhs.it_;
+        }
+
+        const_iterator& operator++();
+        const_iterator operator++(int);
+        const_iterator& operator--();
+        const_iterator operator--(int);
+
+    protected:
+        friend class BinarySearchTree<Key, Value, Compare, Alloc>;
+        iterator it_;
+    };
+
+    typedef std::reverse_iterator<iterator> reverse_iterator;
+    typedef std::reverse_iterator<const_iterator> const_reverse_iterator;
+
+    /**
+    * The items between two iterators, so that a bounded scan can be
+    * written as a range-based for loop.
+    */
+    class Range{
+
+    public:
+        Range(iterator first, iterator last);
+
+        iterator begin() const;
+        iterator end() const;
+        bool empty() const;
+
+    protected:
+        iterator first_;
+        iterator last_;
+    };
+
+    /**
+    * A finger into a tree for lookups that land near the previous one.
+    * Each find or insert starts from the node the last one ended at and
+    * climbs through parent pointers only until it reaches a subtree that
+    * must hold the key, then searches down from there. In a balanced tree
+    * a key d positions away is usually reached in O(log d) steps instead
+    * of O(log n); a key on the far side of a high ancestor still costs
+    * the height of that ancestor.
+    *
+    * Like an iterator, a cursor is invalidated when the node it is at is
+    * removed; reset() sends it back to searching from the root.
+    */
+    class Cursor{
+
+    public:
+        explicit Cursor(BinarySearchTree<Key, Value, Compare, Alloc>& tree);
+
+        iterator find(const Key& key);
+        iterator insert(const std::pair<const Key, Value>& keyValuePair);
+        iterator position() const;
+        void reset();
+
+    protected:
+        BinarySearchTree<Key, Value, Compare, Alloc>* tree_;
+        // the node the last find or insert ended at, or NULL to start at the root
+        Node<Key, Value>* finger_;
+    };
+
+    /**
+    * What validate() found. If valid is false, error says what was wrong
+    * and the other fields only cover the nodes checked before that.
+    */
+    struct TreeStats{
+        bool valid;
+        const char* error;
+        std::size_t count;
+        int height;
+        // whether the heights of the two subtrees of every node differ by at most one
+        bool balanced;
+        // depth_counts[d] is the number of nodes at depth d, the root being at 0
+        std::vector<std::size_t> depth_counts;
     };
 
 public:
     iterator begin() const;
     iterator end() const;
+    reverse_iterator rbegin() const;
+    reverse_iterator rend() const;
+    const_iterator cbegin() const;
+    const_iterator cend() const;
+    const_reverse_iterator crbegin() const;
+    const_reverse_iterator crend() const;
     iterator find(const Key& key) const;
+    template<typename K, typename C = Compare, typename = typename C::is_transparent>
+    iterator find(const K& key) const;
+    iterator lower_bound(const Key& key) const;
+    template<typename K, typename C = Compare, typename = typename C::is_transparent>
+    iterator lower_bound(const K& key) const;
+    iterator upper_bound(const Key& key) const;
+    template<typename K, typename C = Compare, typename = typename C::is_transparent>
+    iterator upper_bound(const K& key) const;
+    std::pair<iterator, iterator> equal_range(const Key& key) const;
+    Range range(const Key& lo, const Key& hi) const;
+    template<typename Function>
+    void forEachInRange(const Key& lo, const Key& hi, Function f) const;
+    std::size_t exportRange(const Key& lo, const Key& hi, Key* keys, Value* values,
+                            std::size_t capacity) const;
+    void findBatch(const Key* keys, std::size_t n, iterator* out) const;
+    Compare key_comp() const;
+
+    // Unlike insert, these leave an existing value alone, as std::map does.
+    // The bool in the result is true if a node was added.
+    template<typename... Args>
+    std::pair<iterator, bool> emplace(Args&&... args);
+    template<typename... Args>
+    std::pair<iterator, bool> try_emplace(const Key& key, Args&&... args);
+    template<typename... Args>
+    std::pair<iterator, bool> try_emplace(Key&& key, Args&&... args);
+    template<typename M>
+    std::pair<iterator, bool> insert_or_assign(const Key& key, M&& obj);
+    template<typename M>
+    std::pair<iterator, bool> insert_or_assign(Key&& key, M&& obj);
+
+    // Same as insert, but hint is tried first as the spot for the key.
+    iterator insert(const_iterator hint, const std::pair<const Key, Value>& keyValuePair);
+    iterator insert(const_iterator hint, std::pair<const Key, Value>&& keyValuePair);
 
 protected:
+    // how many lookups findBatch keeps in flight at once
+    static const std::size_t BATCH_GROUP = 16;
+    // insertBatch rebuilds the tree once the batch is at least 1/BATCH_REBUILD_RATIO of it
+    static const std::size_t BATCH_REBUILD_RATIO = 8;
+
+    /**
+    * A stack of nodes for walking the tree without recursion or parent
+    * pointers. The first INLINE_DEPTH entries live in the object itself,
+    * which covers any balanced tree, so only a degenerate plain
+    * BinarySearchTree ever makes it allocate.
+    */
+    class NodeStack{
+
+    public:
+        NodeStack();
+        NodeStack(const NodeStack&) = delete;
+        NodeStack& operator=(const NodeStack&) = delete;
+
+        void push(Node<Key, Value>* node);
+        Node<Key, Value>* pop();
+        Node<Key, Value>* top() const;
+        bool empty() const;
+
+    protected:
+        static const std::size_t INLINE_DEPTH = 64;
+
+        Node<Key, Value>* inline_[INLINE_DEPTH];
+        std::vector<Node<Key, Value>*> spill_;
+        Node<Key, Value>** data_;
+        std::size_t size_;
+        std::size_t capacity_;
+    };
+
     // Mandatory helper functions
-    Node<Key, Value>* internalFind(const Key& k) const; 
+    template<typename K>
+    Node<Key, Value>* internalFind(const K& k) const; 
+    template<typename K>
+    Node<Key, Value>* internalLowerBound(const K& key) const;
+    template<typename K>
+    Node<Key, Value>* internalUpperBound(const K& key) const;
+    template<typename Visitor>
+    void walkRange(const Key& lo, const Key& hi, Visitor& visit) const;
     Node<Key, Value> *getSmallestNode() const;  
     static Node<Key, Value>* predecessor(Node<Key, Value>* current); 
     // Note:  static means these functions don't have a "this" pointer
@@ -234,11 +496,48 @@ protected:
     virtual void nodeSwap( Node<Key,Value>* n1, Node<Key,Value>* n2) ;
 
     // Add helper functions here
+    static void prefetchNode(const Node<Key, Value>* current);
+    iterator makeIterator(Node<Key, Value>* current) const;
     static Node<Key, Value>* getSmallestNodeSubtree(Node<Key, Value>* current);
     static Node<Key, Value>* getLargestNodeSubtree(Node<Key, Value>* current);
     void clear_helper(Node<Key, Value>* current);
-    int getHeight(Node<Key, Value>* current) const;
-    bool isBalancedHelper(Node<Key, Value>* current) const;
+    Node<Key, Value>* findSlot(const Key& key, Node<Key, Value>*& parent, bool& left) const;
+    Node<Key, Value>* findSlotBelow(Node<Key, Value>* start, const Key& key,
+                                    Node<Key, Value>*& parent, bool& left) const;
+    Node<Key, Value>* findSlotFrom(Node<Key, Value>* finger, const Key& key,
+                                   Node<Key, Value>*& parent, bool& left) const;
+    Node<Key, Value>* findSlotNear(Node<Key, Value>* hint, const Key& key,
+                                   Node<Key, Value>*& parent, bool& left) const;
+    template<typename K, typename V>
+    Node<Key, Value>* insertItem(K&& key, V&& value);
+    template<typename K, typename V>
+    Node<Key, Value>* placeItem(Node<Key, Value>* found, Node<Key, Value>* parent, bool left,
+                                K&& key, V&& value);
+    template<typename NodeType, typename K, typename V>
+    NodeType* createNode(K&& key, V&& value, NodeType* parent);
+    virtual Node<Key, Value>* makeNode(Key&& key, Value&& value, Node<Key, Value>* parent);
+    virtual void linkNode(Node<Key, Value>* node, Node<Key, Value>* parent, bool left);
+    virtual void destroyNode(Node<Key, Value>* current);
+    virtual void valueChanged(Node<Key, Value>* current);
+    virtual bool trivialNodes() const;
+    virtual void finishBuiltNode(Node<Key, Value>* current, int left_height, int right_height);
+
+    // Threading hooks. A tree whose nodes carry in-order links sets
+    // threaded_ and overrides the three virtual ones to read and write
+    // them. The tree keeps the links up to date and the iterators step
+    // through them instead of walking the tree.
+    virtual Node<Key, Value>* nextNode(Node<Key, Value>* current) const;
+    virtual Node<Key, Value>* prevNode(Node<Key, Value>* current) const;
+    virtual void threadNodes(Node<Key, Value>* prev, Node<Key, Value>* next);
+    void thread(Node<Key, Value>* current, Node<Key, Value>* parent, bool left);
+    void unthread(Node<Key, Value>* current);
+    void rethread();
+
+    void rebuildSorted(std::vector<std::pair<Key, Value> >& items);
+    bool hasMoreNodesThan(std::size_t limit) const;
+    int buildSorted(std::vector<std::pair<Key, Value> >& items, std::size_t lo, std::size_t hi,
+                    Node<Key, Value>* parent, bool left);
+    virtual const char* checkNode(Node<Key, Value>* current, int left_height, int right_height) const;
 
     // node helper functions
     static bool isRoot(Node<Key, Value>* current);
@@ -254,7 +553,9 @@ protected:
 
 protected:
     Node<Key, Value>* root_;
-    // You should not need other data members
+    Compare compare_;
+    Alloc allocator_;
+    bool threaded_;
 };
 
 /*
@@ -264,36 +565,39 @@ Begin implementations for the BinarySearchTree::iterator class.
 */
 
 /**
-* Explicit constructor that initializes an iterator with a given node pointer.
+* Explicit constructor that initializes an iterator with a given node pointer
+* in the given tree.
 */
-template<class Key, class Value>
-BinarySearchTree<Key, Value>::iterator::iterator(Node<Key,Value> *ptr){
+template<class Key, class Value, class Compare, class Alloc>
+BinarySearchTree<Key, Value, Compare, Alloc>::iterator::iterator(Node<Key,Value> *ptr,
+    const BinarySearchTree<Key, Value, Compare, Alloc>* tree){
     current_ = ptr;
+    tree_ = tree;
 }
 
 /**
 * A default constructor that initializes the iterator to NULL.
 */
-template<class Key, class Value>
-BinarySearchTree<Key, Value>::iterator::iterator(): current_(nullptr) {
+template<class Key, class Value, class Compare, class Alloc>
+BinarySearchTree<Key, Value, Compare, Alloc>::iterator::iterator(): current_(nullptr), tree_(nullptr) {
 
 }
 
 /**
 * Provides access to the item.
 */
-template<class Key, class Value>
+template<class Key, class Value, class Compare, class Alloc>
 std::pair<const Key,Value> &
-BinarySearchTree<Key, Value>::iterator::operator*() const{
+BinarySearchTree<Key, Value, Compare, Alloc>::iterator::operator*() const{
     return current_->getItem();
 }
 
 /**
 * Provides access to the address of the item.
 */
-template<class Key, class Value>
+template<class Key, class Value, class Compare, class Alloc>
 std::pair<const Key,Value> *
-BinarySearchTree<Key, Value>::iterator::operator->() const{
+BinarySearchTree<Key, Value, Compare, Alloc>::iterator::operator->() const{
     return &(current_->getItem());
 }
 
@@ -301,10 +605,10 @@ BinarySearchTree<Key, Value>::iterator::operator->() const{
 * Checks if 'this' iterator's internals have the same value
 * as 'rhs'
 */
-template<class Key, class Value>
+template<class Key, class Value, class Compare, class Alloc>
 bool
-BinarySearchTree<Key, Value>::iterator::operator==(
-    const BinarySearchTree<Key, Value>::iterator& rhs) const{
+BinarySearchTree<Key, Value, Compare, Alloc>::iterator::operator==(
+    const BinarySearchTree<Key, Value, Compare, Alloc>::iterator& rhs) const{
     return ((current_) == (rhs.current_));
 }
 
@@ -312,10 +616,10 @@ BinarySearchTree<Key, Value>::iterator::operator==(
 * Checks if 'this' iterator's internals have a different value
 * as 'rhs'
 */
-template<class Key, class Value>
+template<class Key, class Value, class Compare, class Alloc>
 bool
-BinarySearchTree<Key, Value>::iterator::operator!=(
-    const BinarySearchTree<Key, Value>::iterator& rhs) const{
+BinarySearchTree<Key, Value, Compare, Alloc>::iterator::operator!=(
+    const BinarySearchTree<Key, Value, Compare, Alloc>::iterator& rhs) const{
     return ((current_) != (rhs.current_));
 }
 
@@ -323,13 +627,59 @@ BinarySearchTree<Key, Value>::iterator::operator!=(
 /**
 * Advances the iterator's location using an in-order sequencing
 */
-template<class Key, class Value>
-typename BinarySearchTree<Key, Value>::iterator&
-BinarySearchTree<Key, Value>::iterator::operator++(){
-    current_ = successor(current_);
+template<class Key, class Value, class Compare, class Alloc>
+typename BinarySearchTree<Key, Value, Compare, Alloc>::iterator&
+BinarySearchTree<Key, Value, Compare, Alloc>::iterator::operator++(){
+    if(tree_ -> threaded_){
+        current_ = tree_ -> nextNode(current_);
+    }
+    else{
+        current_ = successor(current_);
+    }
+    return *this;
+}
+
+/**
+* Advances the iterator and returns where it was.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+typename BinarySearchTree<Key, Value, Compare, Alloc>::iterator
+BinarySearchTree<Key, Value, Compare, Alloc>::iterator::operator++(int){
+    iterator previous = *this;
+    ++(*this);
+    return previous;
+}
+
+/**
+* Moves the iterator back using an in-order sequencing. Moving back
+* from end() gives the largest item.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+typename BinarySearchTree<Key, Value, Compare, Alloc>::iterator&
+BinarySearchTree<Key, Value, Compare, Alloc>::iterator::operator--(){
+    if(current_ == nullptr){
+        current_ = getLargestNodeSubtree(tree_ -> root_);
+    }
+    else if(tree_ -> threaded_){
+        current_ = tree_ -> prevNode(current_);
+    }
+    else{
+        current_ = predecessor(current_);
+    }
     return *this;
 }
 
+/**
+* Moves the iterator back and returns where it was.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+typename BinarySearchTree<Key, Value, Compare, Alloc>::iterator
+BinarySearchTree<Key, Value, Compare, Alloc>::iterator::operator--(int){
+    iterator previous = *this;
+    --(*this);
+    return previous;
+}
+
 
 /*
 -------------------------------------------------------------
@@ -337,6 +687,235 @@ End implementations for the BinarySearchTree::iterator class.
 -------------------------------------------------------------
 */
 
+/*
+-------------------------------------------------------------------
+Begin implementations for the BinarySearchTree::const_iterator class.
+-------------------------------------------------------------------
+*/
+
+/**
+* A default constructor that initializes the iterator to NULL.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+BinarySearchTree<Key, Value, Compare, Alloc>::const_iterator::const_iterator(){
+
+}
+
+/**
+* Converts an iterator to a const_iterator at the same item.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+BinarySearchTree<Key, Value, Compare, Alloc>::const_iterator::const_iterator(const iterator& it) :
+    it_(it){
+
+}
+
+/**
+* Provides read-only access to the item.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+const std::pair<const Key,Value> &
+BinarySearchTree<Key, Value, Compare, Alloc>::const_iterator::operator*() const{
+    return *it_;
+}
+
+/**
+* Provides the address of the item, read-only.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+const std::pair<const Key,Value> *
+BinarySearchTree<Key, Value, Compare, Alloc>::const_iterator::operator->() const{
+    return it_.operator->();
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+typename BinarySearchTree<Key, Value, Compare, Alloc>::const_iterator&
+BinarySearchTree<Key, Value, Compare, Alloc>::const_iterator::operator++(){
+    ++it_;
+    return *this;
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+typename BinarySearchTree<Key, Value, Compare, Alloc>::const_iterator
+BinarySearchTree<Key, Value, Compare, Alloc>::const_iterator::operator++(int){
+    const_iterator previous = *this;
+    ++it_;
+    return previous;
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+typename BinarySearchTree<Key, Value, Compare, Alloc>::const_iterator&
+BinarySearchTree<Key, Value, Compare, Alloc>::const_iterator::operator--(){
+    --it_;
+    return *this;
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+typename BinarySearchTree<Key, Value, Compare, Alloc>::const_iterator
+BinarySearchTree<Key, Value, Compare, Alloc>::const_iterator::operator--(int){
+    const_iterator previous = *this;
+    --it_;
+    return previous;
+}
+
+/*
+-----------------------------------------------------------------
+End implementations for the BinarySearchTree::const_iterator class.
+-----------------------------------------------------------------
+*/
+
+/*
+-----------------------------------------------------------
+Begin implementations for the BinarySearchTree::Range class.
+-----------------------------------------------------------
+*/
+
+/**
+* A range over [first, last). last must be reachable from first.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+BinarySearchTree<Key, Value, Compare, Alloc>::Range::Range(iterator first, iterator last) :
+    first_(first), last_(last){
+
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+typename BinarySearchTree<Key, Value, Compare, Alloc>::iterator
+BinarySearchTree<Key, Value, Compare, Alloc>::Range::begin() const{
+    return first_;
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+typename BinarySearchTree<Key, Value, Compare, Alloc>::iterator
+BinarySearchTree<Key, Value, Compare, Alloc>::Range::end() const{
+    return last_;
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+bool BinarySearchTree<Key, Value, Compare, Alloc>::Range::empty() const{
+    return first_ == last_;
+}
+
+/*
+---------------------------------------------------------
+End implementations for the BinarySearchTree::Range class.
+---------------------------------------------------------
+*/
+
+/*
+------------------------------------------------------------
+Begin implementations for the BinarySearchTree::Cursor class.
+------------------------------------------------------------
+*/
+
+/**
+* A cursor over tree whose first search starts at the root.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+BinarySearchTree<Key, Value, Compare, Alloc>::Cursor::Cursor(BinarySearchTree<Key, Value, Compare, Alloc>& tree) :
+    tree_(&tree), finger_(nullptr){
+
+}
+
+/**
+* Returns an iterator to key, or end() if it is not in the tree. Either
+* way the cursor moves to where the search ended, which on a miss is a
+* neighbour of key.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+typename BinarySearchTree<Key, Value, Compare, Alloc>::iterator
+BinarySearchTree<Key, Value, Compare, Alloc>::Cursor::find(const Key& key){
+    Node<Key, Value>* parent = nullptr;
+    bool left = false;
+    Node<Key, Value>* found = tree_ -> findSlotFrom(finger_, key, parent, left);
+    finger_ = found != nullptr ? found : parent;
+    return iterator(found, tree_);
+}
+
+/**
+* Inserts like the tree's insert does and moves the cursor to the key.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+typename BinarySearchTree<Key, Value, Compare, Alloc>::iterator
+BinarySearchTree<Key, Value, Compare, Alloc>::Cursor::insert(const std::pair<const Key, Value>& keyValuePair){
+    iterator it = tree_ -> insert(const_iterator(iterator(finger_, tree_)), keyValuePair);
+    finger_ = it.current_;
+    return it;
+}
+
+/**
+* An iterator to the node the cursor is at, or end() if it has none yet.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+typename BinarySearchTree<Key, Value, Compare, Alloc>::iterator
+BinarySearchTree<Key, Value, Compare, Alloc>::Cursor::position() const{
+    return iterator(finger_, tree_);
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+void BinarySearchTree<Key, Value, Compare, Alloc>::Cursor::reset(){
+    finger_ = nullptr;
+}
+
+/*
+----------------------------------------------------------
+End implementations for the BinarySearchTree::Cursor class.
+----------------------------------------------------------
+*/
+
+/*
+---------------------------------------------------------------
+Begin implementations for the BinarySearchTree::NodeStack class.
+---------------------------------------------------------------
+*/
+
+/**
+* Constructor for an empty stack using the inline entries.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+BinarySearchTree<Key, Value, Compare, Alloc>::NodeStack::NodeStack() :
+    data_(inline_), size_(0), capacity_(INLINE_DEPTH){
+
+}
+
+/**
+* Pushes node, moving the stack to the heap the first time the inline
+* entries run out and doubling it after that.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+void BinarySearchTree<Key, Value, Compare, Alloc>::NodeStack::push(Node<Key, Value>* node){
+    if(size_ == capacity_){
+        if(data_ == inline_){
+            spill_.assign(inline_, inline_ + size_);
+        }
+        capacity_ *= 2;
+        spill_.resize(capacity_);
+        data_ = spill_.data();
+    }
+    data_[size_++] = node;
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare, Alloc>::NodeStack::pop(){
+    return data_[--size_];
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare, Alloc>::NodeStack::top() const{
+    return data_[size_ - 1];
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+bool BinarySearchTree<Key, Value, Compare, Alloc>::NodeStack::empty() const{
+    return size_ == 0;
+}
+
+/*
+-------------------------------------------------------------
+End implementations for the BinarySearchTree::NodeStack class.
+-------------------------------------------------------------
+*/
+
 /*
 -----------------------------------------------------
 Begin implementations for the BinarySearchTree class.
@@ -346,26 +925,27 @@ Begin implementations for the BinarySearchTree class.
 /**
 * Default constructor for a BinarySearchTree, which sets the root to NULL.
 */
-template<class Key, class Value>
-BinarySearchTree<Key, Value>::BinarySearchTree(): root_(nullptr) {
+template<class Key, class Value, class Compare, class Alloc>
+BinarySearchTree<Key, Value, Compare, Alloc>::BinarySearchTree(const Compare& compare):
+    root_(nullptr), compare_(compare), threaded_(false) {
 
 }
 
-template<typename Key, typename Value>
-BinarySearchTree<Key, Value>::~BinarySearchTree(){
+template<typename Key, typename Value, typename Compare, typename Alloc>
+BinarySearchTree<Key, Value, Compare, Alloc>::~BinarySearchTree(){
     clear();
 }
 
 /**
  * Returns true if tree is empty
 */
-template<class Key, class Value>
-bool BinarySearchTree<Key, Value>::empty() const{
+template<class Key, class Value, class Compare, class Alloc>
+bool BinarySearchTree<Key, Value, Compare, Alloc>::empty() const{
     return root_ == NULL;
 }
 
-template<typename Key, typename Value>
-void BinarySearchTree<Key, Value>::print() const{
+template<typename Key, typename Value, typename Compare, typename Alloc>
+void BinarySearchTree<Key, Value, Compare, Alloc>::print() const{
     printRoot(root_);
     std::cout << "\n";
 }
@@ -373,110 +953,436 @@ void BinarySearchTree<Key, Value>::print() const{
 /**
 * Returns an iterator to the "smallest" item in the tree
 */
-template<class Key, class Value>
-typename BinarySearchTree<Key, Value>::iterator
-BinarySearchTree<Key, Value>::begin() const{
-    BinarySearchTree<Key, Value>::iterator begin(getSmallestNode());
+template<class Key, class Value, class Compare, class Alloc>
+typename BinarySearchTree<Key, Value, Compare, Alloc>::iterator
+BinarySearchTree<Key, Value, Compare, Alloc>::begin() const{
+    BinarySearchTree<Key, Value, Compare, Alloc>::iterator begin(getSmallestNode(), this);
     return begin;
 }
 
 /**
 * Returns an iterator whose value means INVALID
 */
-template<class Key, class Value>
-typename BinarySearchTree<Key, Value>::iterator
-BinarySearchTree<Key, Value>::end() const{
-    BinarySearchTree<Key, Value>::iterator end(NULL);
+template<class Key, class Value, class Compare, class Alloc>
+typename BinarySearchTree<Key, Value, Compare, Alloc>::iterator
+BinarySearchTree<Key, Value, Compare, Alloc>::end() const{
+    BinarySearchTree<Key, Value, Compare, Alloc>::iterator end(NULL, this);
     return end;
 }
 
+/**
+* Returns a reverse iterator to the "largest" item in the tree
+*/
+template<class Key, class Value, class Compare, class Alloc>
+typename BinarySearchTree<Key, Value, Compare, Alloc>::reverse_iterator
+BinarySearchTree<Key, Value, Compare, Alloc>::rbegin() const{
+    return reverse_iterator(end());
+}
+
+/**
+* Returns a reverse iterator past the "smallest" item in the tree
+*/
+template<class Key, class Value, class Compare, class Alloc>
+typename BinarySearchTree<Key, Value, Compare, Alloc>::reverse_iterator
+BinarySearchTree<Key, Value, Compare, Alloc>::rend() const{
+    return reverse_iterator(begin());
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+typename BinarySearchTree<Key, Value, Compare, Alloc>::const_iterator
+BinarySearchTree<Key, Value, Compare, Alloc>::cbegin() const{
+    return const_iterator(begin());
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+typename BinarySearchTree<Key, Value, Compare, Alloc>::const_iterator
+BinarySearchTree<Key, Value, Compare, Alloc>::cend() const{
+    return const_iterator(end());
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+typename BinarySearchTree<Key, Value, Compare, Alloc>::const_reverse_iterator
+BinarySearchTree<Key, Value, Compare, Alloc>::crbegin() const{
+    return const_reverse_iterator(cend());
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+typename BinarySearchTree<Key, Value, Compare, Alloc>::const_reverse_iterator
+BinarySearchTree<Key, Value, Compare, Alloc>::crend() const{
+    return const_reverse_iterator(cbegin());
+}
+
 /**
 * Returns an iterator to the item with the given key, k
 * or the end iterator if k does not exist in the tree
 */
-template<class Key, class Value>
-typename BinarySearchTree<Key, Value>::iterator
-BinarySearchTree<Key, Value>::find(const Key & k) const{
+template<class Key, class Value, class Compare, class Alloc>
+typename BinarySearchTree<Key, Value, Compare, Alloc>::iterator
+BinarySearchTree<Key, Value, Compare, Alloc>::find(const Key & k) const{
     Node<Key, Value> *curr = internalFind(k);
-    BinarySearchTree<Key, Value>::iterator it(curr);
+    BinarySearchTree<Key, Value, Compare, Alloc>::iterator it(curr, this);
     return it;
 }
 
 /**
-* An insert method to insert into a Binary Search Tree.
-* The tree will not remain balanced when inserting.
-* if key is already in the tree, you should overwrite the current
-* value with the updated value
+* Same as find, for any type that Compare can order against Key.
+* Only available when Compare is transparent (has is_transparent),
+* e.g. std::less<> lets a std::string tree be searched with a
+* std::string_view without building a std::string.
 */
-template<class Key, class Value>
-void BinarySearchTree<Key, Value>::insert(const std::pair<const Key, Value> &keyValuePair){
-    
-    Key new_key = keyValuePair.first;
-    Value new_value = keyValuePair.second;
-
-    //start at the root
-    Node<Key, Value>* current = root_;
+template<class Key, class Value, class Compare, class Alloc>
+template<typename K, typename C, typename>
+typename BinarySearchTree<Key, Value, Compare, Alloc>::iterator
+BinarySearchTree<Key, Value, Compare, Alloc>::find(const K & k) const{
+    Node<Key, Value> *curr = internalFind(k);
+    BinarySearchTree<Key, Value, Compare, Alloc>::iterator it(curr, this);
+    return it;
+}
 
-    //if tree is empty
-    if(current == nullptr){
-        root_ = new Node<Key, Value>(new_key, new_value, current);
-        return;
-    }
+/**
+* Returns an iterator to the first item whose key is not less than key,
+* or end() if there is none.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+typename BinarySearchTree<Key, Value, Compare, Alloc>::iterator
+BinarySearchTree<Key, Value, Compare, Alloc>::lower_bound(const Key& key) const{
+    return iterator(internalLowerBound(key), this);
+}
 
-    //walk the tree
-    bool node_inserted = false;
-    while(node_inserted == false){
-        //get the current node's key and compare with the key 
-        //that we're trying to insert
-        Key current_key = current -> getKey();
-
-        //if the current key is equal
-        if(current_key == new_key){
-            current -> setValue(new_value);
-            node_inserted = true;
-        }
-        //if less than, go left
-        else if(new_key < current_key){
-            //if there's an empty spot
-            if(hasLeftChild(current) == false){
-                Node<Key, Value>* new_node = new Node<Key, Value>(new_key, new_value, current);
-                current -> setLeft(new_node);
-                node_inserted = true;
-            }
-            else{
-                current = current -> getLeft();
-            }
-        }
-        //if greater than, go right
-        else if(new_key > current_key){
-            //if there's an empty spot
-            if(hasRightChild(current) == false){
-                Node<Key, Value>* new_node = new Node<Key, Value>(new_key, new_value, current);
-                current -> setRight(new_node);
-                node_inserted = true;
-            }
-            else{
-                current = current -> getRight();
-            }
-        }
-    }
-    return;
+/**
+* Same as lower_bound, for any type a transparent Compare can order
+* against Key.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+template<typename K, typename C, typename>
+typename BinarySearchTree<Key, Value, Compare, Alloc>::iterator
+BinarySearchTree<Key, Value, Compare, Alloc>::lower_bound(const K& key) const{
+    return iterator(internalLowerBound(key), this);
 }
 
 /**
-* A remove method to remove a specific key from a Binary Search Tree.
-* The tree may not remain balanced after removal.
-* If the key is not already in the tree, this function will do nothing.
-* If the node to be removed has two children, swap with its predecessor 
-* (not its successor) in the BST removal algorithm. If the node to be 
-* removed has exactly one child, you can promote the child. 
+* Returns an iterator to the first item whose key is greater than key,
+* or end() if there is none.
 */
-template<typename Key, typename Value>
-void BinarySearchTree<Key, Value>::remove(const Key& key){
-    
-    Node<Key, Value>* node_to_remove = internalFind(key);
+template<class Key, class Value, class Compare, class Alloc>
+typename BinarySearchTree<Key, Value, Compare, Alloc>::iterator
+BinarySearchTree<Key, Value, Compare, Alloc>::upper_bound(const Key& key) const{
+    return iterator(internalUpperBound(key), this);
+}
 
-    //if key is not in tree, do nothing
+/**
+* Same as upper_bound, for any type a transparent Compare can order
+* against Key.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+template<typename K, typename C, typename>
+typename BinarySearchTree<Key, Value, Compare, Alloc>::iterator
+BinarySearchTree<Key, Value, Compare, Alloc>::upper_bound(const K& key) const{
+    return iterator(internalUpperBound(key), this);
+}
+
+/**
+* Returns the items whose key is equal to key as a pair of iterators,
+* which is either empty or holds one item since keys are unique.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+std::pair<typename BinarySearchTree<Key, Value, Compare, Alloc>::iterator,
+          typename BinarySearchTree<Key, Value, Compare, Alloc>::iterator>
+BinarySearchTree<Key, Value, Compare, Alloc>::equal_range(const Key& key) const{
+    Node<Key, Value>* first = internalLowerBound(key);
+    if(first == nullptr || compare_(key, first -> getKey())){
+        return std::make_pair(iterator(first, this), iterator(first, this));
+    }
+    return std::make_pair(iterator(first, this), iterator(successor(first), this));
+}
+
+/**
+* Returns the items with lo <= key < hi, found with two descents, so a
+* scan over k items costs O(log n + k).
+*/
+template<class Key, class Value, class Compare, class Alloc>
+typename BinarySearchTree<Key, Value, Compare, Alloc>::Range
+BinarySearchTree<Key, Value, Compare, Alloc>::range(const Key& lo, const Key& hi) const{
+    iterator first = lower_bound(lo);
+    if(!compare_(lo, hi)){
+        return Range(first, first);
+    }
+    return Range(first, lower_bound(hi));
+}
+
+/**
+* Calls f(item) for every item with lo <= key < hi, in order. The walk
+* keeps its own stack of the nodes still to visit, so it never climbs
+* back up through parent pointers, and costs O(log n + k) for k items.
+* f must not add or remove items.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+template<typename Function>
+void BinarySearchTree<Key, Value, Compare, Alloc>::forEachInRange(const Key& lo, const Key& hi, Function f) const{
+    auto visit = [&f](Node<Key, Value>* node){
+        f(node -> getItem());
+        return true;
+    };
+    walkRange(lo, hi, visit);
+}
+
+/**
+* Copies the keys and values of the items with lo <= key < hi, in order,
+* into keys[0..n) and values[0..n), and returns n. Either array can be
+* NULL to skip that column. Stops after capacity items, so a return of
+* capacity means there may be more; the next batch starts just past
+* keys[capacity - 1].
+*/
+template<class Key, class Value, class Compare, class Alloc>
+std::size_t BinarySearchTree<Key, Value, Compare, Alloc>::exportRange(const Key& lo, const Key& hi,
+                                                           Key* keys, Value* values,
+                                                           std::size_t capacity) const{
+    std::size_t count = 0;
+    if(capacity == 0){
+        return count;
+    }
+    auto visit = [&](Node<Key, Value>* node){
+        if(keys != nullptr){
+            keys[count] = node -> getKey();
+        }
+        if(values != nullptr){
+            values[count] = node -> getValue();
+        }
+        return ++count < capacity;
+    };
+    walkRange(lo, hi, visit);
+    return count;
+}
+
+/**
+* Looks up keys[0..n) and stores the result of find(keys[i]) in out[i].
+* The lookups are walked in groups of BATCH_GROUP, one level of every
+* lookup in the group per round, and the next node of each one is
+* prefetched as soon as it is known. By the time a round comes back to
+* a lookup its node is usually in cache, so the misses of the whole
+* group overlap instead of each lookup waiting on its own chain of
+* pointer loads.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+void BinarySearchTree<Key, Value, Compare, Alloc>::findBatch(const Key* keys, std::size_t n,
+                                                  iterator* out) const{
+    Node<Key, Value>* current[BATCH_GROUP];
+    Node<Key, Value>* candidate[BATCH_GROUP];
+
+    for(std::size_t base = 0; base < n; base += BATCH_GROUP){
+        const Key* group = keys + base;
+        std::size_t count = n - base < BATCH_GROUP ? n - base : BATCH_GROUP;
+        for(std::size_t i = 0; i < count; ++i){
+            current[i] = root_;
+            candidate[i] = nullptr;
+        }
+
+        //same walk as internalFind, interleaved across the group
+        bool active = root_ != nullptr;
+        while(active){
+            active = false;
+            for(std::size_t i = 0; i < count; ++i){
+                Node<Key, Value>* node = current[i];
+                if(node == nullptr){
+                    continue;
+                }
+                if(compare_(node -> getKey(), group[i])){
+                    node = node -> getRight();
+                }
+                else{
+                    candidate[i] = node;
+                    node = node -> getLeft();
+                }
+                current[i] = node;
+                if(node != nullptr){
+                    prefetchNode(node);
+                    active = true;
+                }
+            }
+        }
+
+        for(std::size_t i = 0; i < count; ++i){
+            Node<Key, Value>* found = candidate[i];
+            if(found != nullptr && compare_(group[i], found -> getKey())){
+                found = nullptr;
+            }
+            out[base + i] = iterator(found, this);
+        }
+    }
+}
+
+/**
+* Returns a copy of the comparison object used to order the keys.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+Compare BinarySearchTree<Key, Value, Compare, Alloc>::key_comp() const{
+    return compare_;
+}
+
+/**
+* An insert method to insert into a Binary Search Tree.
+* The tree will not remain balanced when inserting.
+* if key is already in the tree, you should overwrite the current
+* value with the updated value
+*/
+template<class Key, class Value, class Compare, class Alloc>
+void BinarySearchTree<Key, Value, Compare, Alloc>::insert(const std::pair<const Key, Value> &keyValuePair){
+    insertItem(keyValuePair.first, keyValuePair.second);
+}
+
+/**
+* Same as the insert above, but the value is moved into the tree.
+* The key is still copied since it is const in the pair.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+void BinarySearchTree<Key, Value, Compare, Alloc>::insert(std::pair<const Key, Value>&& keyValuePair){
+    insertItem(keyValuePair.first, std::move(keyValuePair.second));
+}
+
+/**
+* Constructs a pair from args and adds it if its key is not in the tree yet.
+* The pair is built first since its key is needed to find the spot; both
+* halves are then moved into the node.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+template<typename... Args>
+std::pair<typename BinarySearchTree<Key, Value, Compare, Alloc>::iterator, bool>
+BinarySearchTree<Key, Value, Compare, Alloc>::emplace(Args&&... args){
+    std::pair<Key, Value> item(std::forward<Args>(args)...);
+
+    Node<Key, Value>* parent = nullptr;
+    bool left = false;
+    Node<Key, Value>* found = findSlot(item.first, parent, left);
+    if(found != nullptr){
+        return std::make_pair(iterator(found, this), false);
+    }
+    Node<Key, Value>* new_node = makeNode(std::move(item.first), std::move(item.second), parent);
+    linkNode(new_node, parent, left);
+    return std::make_pair(iterator(new_node, this), true);
+}
+
+/**
+* Adds key with a value constructed from args, unless key is already in the
+* tree, in which case nothing is constructed.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+template<typename... Args>
+std::pair<typename BinarySearchTree<Key, Value, Compare, Alloc>::iterator, bool>
+BinarySearchTree<Key, Value, Compare, Alloc>::try_emplace(const Key& key, Args&&... args){
+    Node<Key, Value>* parent = nullptr;
+    bool left = false;
+    Node<Key, Value>* found = findSlot(key, parent, left);
+    if(found != nullptr){
+        return std::make_pair(iterator(found, this), false);
+    }
+    Node<Key, Value>* new_node = makeNode(Key(key), Value(std::forward<Args>(args)...), parent);
+    linkNode(new_node, parent, left);
+    return std::make_pair(iterator(new_node, this), true);
+}
+
+/**
+* Same as the try_emplace above, but the key is moved into the tree.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+template<typename... Args>
+std::pair<typename BinarySearchTree<Key, Value, Compare, Alloc>::iterator, bool>
+BinarySearchTree<Key, Value, Compare, Alloc>::try_emplace(Key&& key, Args&&... args){
+    Node<Key, Value>* parent = nullptr;
+    bool left = false;
+    Node<Key, Value>* found = findSlot(key, parent, left);
+    if(found != nullptr){
+        return std::make_pair(iterator(found, this), false);
+    }
+    Node<Key, Value>* new_node = makeNode(std::move(key), Value(std::forward<Args>(args)...), parent);
+    linkNode(new_node, parent, left);
+    return std::make_pair(iterator(new_node, this), true);
+}
+
+/**
+* Assigns obj to the value of key, adding key first if it is not in the tree.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+template<typename M>
+std::pair<typename BinarySearchTree<Key, Value, Compare, Alloc>::iterator, bool>
+BinarySearchTree<Key, Value, Compare, Alloc>::insert_or_assign(const Key& key, M&& obj){
+    Node<Key, Value>* parent = nullptr;
+    bool left = false;
+    Node<Key, Value>* found = findSlot(key, parent, left);
+    if(found != nullptr){
+        found -> getValue() = std::forward<M>(obj);
+        valueChanged(found);
+        return std::make_pair(iterator(found, this), false);
+    }
+    Node<Key, Value>* new_node = makeNode(Key(key), Value(std::forward<M>(obj)), parent);
+    linkNode(new_node, parent, left);
+    return std::make_pair(iterator(new_node, this), true);
+}
+
+/**
+* Same as the insert_or_assign above, but the key is moved into the tree.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+template<typename M>
+std::pair<typename BinarySearchTree<Key, Value, Compare, Alloc>::iterator, bool>
+BinarySearchTree<Key, Value, Compare, Alloc>::insert_or_assign(Key&& key, M&& obj){
+    Node<Key, Value>* parent = nullptr;
+    bool left = false;
+    Node<Key, Value>* found = findSlot(key, parent, left);
+    if(found != nullptr){
+        found -> getValue() = std::forward<M>(obj);
+        valueChanged(found);
+        return std::make_pair(iterator(found, this), false);
+    }
+    Node<Key, Value>* new_node = makeNode(std::move(key), Value(std::forward<M>(obj)), parent);
+    linkNode(new_node, parent, left);
+    return std::make_pair(iterator(new_node, this), true);
+}
+
+/**
+* Inserts like insert does, but first tries to attach the key right next
+* to hint. When the key belongs just before or just after hint no
+* comparisons are made on the way down from the root, so feeding back
+* the iterator returned, or passing end(), makes sorted appends cheap.
+* A wrong hint costs two comparisons before the usual search.
+* Returns an iterator to the key's node.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+typename BinarySearchTree<Key, Value, Compare, Alloc>::iterator
+BinarySearchTree<Key, Value, Compare, Alloc>::insert(const_iterator hint,
+                                                     const std::pair<const Key, Value>& keyValuePair){
+    Node<Key, Value>* parent = nullptr;
+    bool left = false;
+    Node<Key, Value>* found = findSlotNear(hint.it_.current_, keyValuePair.first, parent, left);
+    return iterator(placeItem(found, parent, left, keyValuePair.first, keyValuePair.second), this);
+}
+
+/**
+* Same as the hinted insert above, but the value is moved into the tree.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+typename BinarySearchTree<Key, Value, Compare, Alloc>::iterator
+BinarySearchTree<Key, Value, Compare, Alloc>::insert(const_iterator hint,
+                                                     std::pair<const Key, Value>&& keyValuePair){
+    Node<Key, Value>* parent = nullptr;
+    bool left = false;
+    Node<Key, Value>* found = findSlotNear(hint.it_.current_, keyValuePair.first, parent, left);
+    return iterator(placeItem(found, parent, left, keyValuePair.first, std::move(keyValuePair.second)), this);
+}
+
+/**
+* A remove method to remove a specific key from a Binary Search Tree.
+* The tree may not remain balanced after removal.
+* If the key is not already in the tree, this function will do nothing.
+* If the node to be removed has two children, swap with its predecessor 
+* (not its successor) in the BST removal algorithm. If the node to be 
+* removed has exactly one child, you can promote the child. 
+*/
+template<typename Key, typename Value, typename Compare, typename Alloc>
+void BinarySearchTree<Key, Value, Compare, Alloc>::remove(const Key& key){
+    
+    Node<Key, Value>* node_to_remove = internalFind(key);
+
+    //if key is not in tree, do nothing
     if(node_to_remove == nullptr){
         return;
     }
@@ -496,7 +1402,8 @@ void BinarySearchTree<Key, Value>::remove(const Key& key){
                 parent -> setRight(nullptr);
             }
         }
-        delete node_to_remove;
+        unthread(node_to_remove);
+        destroyNode(node_to_remove);
     }
     
     //if node has one child, promote the child
@@ -527,7 +1434,8 @@ void BinarySearchTree<Key, Value>::remove(const Key& key){
             }
             child -> setParent(parent);
         }
-        delete node_to_remove;
+        unthread(node_to_remove);
+        destroyNode(node_to_remove);
     }
     //if node has two children, swap with predecessor
     else if(hasTwoChildren(node_to_remove)){
@@ -577,14 +1485,15 @@ void BinarySearchTree<Key, Value>::remove(const Key& key){
             }
             current_child -> setParent(current_parent);
         }
-        delete node_to_remove;
+        unthread(node_to_remove);
+        destroyNode(node_to_remove);
     }
     return;
 }
 
-template<class Key, class Value>
+template<class Key, class Value, class Compare, class Alloc>
 Node<Key, Value>*
-BinarySearchTree<Key, Value>::predecessor(Node<Key, Value>* current){
+BinarySearchTree<Key, Value, Compare, Alloc>::predecessor(Node<Key, Value>* current){
     
     Node<Key, Value>* temp =  nullptr;
 
@@ -614,9 +1523,9 @@ BinarySearchTree<Key, Value>::predecessor(Node<Key, Value>* current){
     return temp;
 }
 
-template<class Key, class Value>
+template<class Key, class Value, class Compare, class Alloc>
 Node<Key, Value>*
-BinarySearchTree<Key, Value>::successor(Node<Key, Value>* current){
+BinarySearchTree<Key, Value, Compare, Alloc>::successor(Node<Key, Value>* current){
 
     Node<Key, Value>* temp =  nullptr;
 
@@ -649,20 +1558,137 @@ BinarySearchTree<Key, Value>::successor(Node<Key, Value>* current){
 /**
 * A method to remove all contents of the tree and
 * reset the values in the tree for use again.
+* If the allocator can free everything at once and the items have
+* nothing to destroy, the nodes are never visited. They still are while
+* the allocator shares memory with another tree's, so that it can tell
+* when none of the shared memory is in use any more.
 */
-template<typename Key, typename Value>
-void BinarySearchTree<Key, Value>::clear(){
-    clear_helper(root_);
+template<typename Key, typename Value, typename Compare, typename Alloc>
+void BinarySearchTree<Key, Value, Compare, Alloc>::clear(){
+    bool skip_walk = Alloc::bulk_release && trivialNodes() && allocator_.exclusive();
+    if(!skip_walk){
+        clear_helper(root_);
+    }
+    allocator_.release();
     root_ = nullptr;
 }
 
 
+/**
+* Replaces the contents of the tree with the pairs in [first, last), which
+* must be sorted by the comparator. If a key repeats, the last value wins.
+* Builds a perfectly balanced tree in O(n) without any comparisons on the
+* way down or rotations. Invalidates all iterators.
+* Throws std::invalid_argument, leaving the tree as it was, if a key is
+* less than the one before it.
+*/
+template<typename Key, typename Value, typename Compare, typename Alloc>
+template<typename InputIt>
+void BinarySearchTree<Key, Value, Compare, Alloc>::assignSorted(InputIt first, InputIt last){
+
+    std::vector<std::pair<Key, Value> > items;
+    for(; first != last; ++first){
+        if(!items.empty() && !compare_(items.back().first, (*first).first)){
+            if(compare_((*first).first, items.back().first)){
+                throw std::invalid_argument("assignSorted needs its pairs sorted by key");
+            }
+            items.back().second = (*first).second;
+        }
+        else{
+            items.push_back(*first);
+        }
+    }
+
+    rebuildSorted(items);
+}
+
+/**
+* Inserts every pair in [first, last), which can be in any order. As with
+* insert, an existing value is overwritten, and if the batch holds a key
+* more than once the last one wins.
+* The batch is sorted and deduplicated first. If it is small next to the
+* tree, it is inserted in key order, so consecutive descents share most of
+* their path and find it in cache. Otherwise the tree and the batch are
+* merged in one sequential pass and the tree is rebuilt from the result as
+* assignSorted does, which invalidates all iterators.
+* If an exception is thrown on the rebuild path the tree is left as it was.
+* On the in-order path the pairs inserted before it stay in the tree.
+*/
+template<typename Key, typename Value, typename Compare, typename Alloc>
+template<typename InputIt>
+void BinarySearchTree<Key, Value, Compare, Alloc>::insertBatch(InputIt first, InputIt last){
+
+    std::vector<std::pair<Key, Value> > batch;
+    for(; first != last; ++first){
+        batch.push_back(*first);
+    }
+    if(batch.empty()){
+        return;
+    }
+
+    //sort by key, keeping equal keys in batch order, then keep the last of each run
+    std::stable_sort(batch.begin(), batch.end(),
+                     [this](const std::pair<Key, Value>& a, const std::pair<Key, Value>& b){
+                         return compare_(a.first, b.first);
+                     });
+    std::size_t unique = 0;
+    for(std::size_t i = 0; i < batch.size(); ++i){
+        if(i + 1 < batch.size() && !compare_(batch[i].first, batch[i + 1].first)){
+            continue;
+        }
+        if(unique != i){
+            batch[unique] = std::move(batch[i]);
+        }
+        ++unique;
+    }
+    batch.erase(batch.begin() + unique, batch.end());
+
+    if(hasMoreNodesThan(batch.size() * BATCH_REBUILD_RATIO)){
+        for(std::size_t i = 0; i < batch.size(); ++i){
+            insertItem(std::move(batch[i].first), std::move(batch[i].second));
+        }
+        return;
+    }
+
+    //merge the tree's items with the batch, the batch winning on equal keys
+    std::vector<std::pair<Key, Value> > merged;
+    merged.reserve(batch.size() * (BATCH_REBUILD_RATIO + 1));
+    std::size_t next = 0;
+    for(iterator it = begin(); it != end(); ++it){
+        while(next < batch.size() && compare_(batch[next].first, it -> first)){
+            merged.push_back(std::move(batch[next]));
+            ++next;
+        }
+        if(next < batch.size() && !compare_(it -> first, batch[next].first)){
+            merged.push_back(std::move(batch[next]));
+            ++next;
+        }
+        else{
+            merged.push_back(std::pair<Key, Value>(it -> first, it -> second));
+        }
+    }
+    for(; next < batch.size(); ++next){
+        merged.push_back(std::move(batch[next]));
+    }
+
+    rebuildSorted(merged);
+}
+
+/**
+* Returns an immutable, read-optimized copy of the tree. See FrozenTree.
+* The copy does not follow later changes to the tree.
+*/
+template<typename Key, typename Value, typename Compare, typename Alloc>
+FrozenTree<Key, Value, Compare> BinarySearchTree<Key, Value, Compare, Alloc>::freeze() const{
+    return FrozenTree<Key, Value, Compare>(begin(), end(), compare_);
+}
+
 /**
 * A helper function to find the smallest node in the tree.
 */
-template<typename Key, typename Value>
+template<typename Key, typename Value, typename Compare, typename Alloc>
 Node<Key, Value>*
-BinarySearchTree<Key, Value>::getSmallestNode() const{
+BinarySearchTree<Key, Value, Compare, Alloc>::getSmallestNode() const{
     Node<Key, Value>* temp = getSmallestNodeSubtree(root_);
     return temp;
 }
@@ -670,57 +1696,231 @@ BinarySearchTree<Key, Value>::getSmallestNode() const{
 /**
 * Helper function to find a node with given key, k and
 * return a pointer to it or NULL if no item with that key
-* exists
+* exists.
+* Only one comparison is made per level: the walk finds the first
+* node whose key is not less than k and checks that one for
+* equality at the bottom. K can differ from Key when Compare is
+* transparent.
 */
-template<typename Key, typename Value>
-Node<Key, Value>* BinarySearchTree<Key, Value>::internalFind(const Key& key) const{
-    Node<Key, Value>* internal_find = nullptr;
+template<typename Key, typename Value, typename Compare, typename Alloc>
+template<typename K>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare, Alloc>::internalFind(const K& key) const{
+    Node<Key, Value>* candidate = internalLowerBound(key);
+
+    if(candidate != nullptr && !compare_(key, candidate -> getKey())){
+        return candidate;
+    }
+    return nullptr;
+}
+
+/**
+* Helper function to find the first node whose key is not less than
+* key, or NULL. The walk remembers the last node where it went left.
+*/
+template<typename Key, typename Value, typename Compare, typename Alloc>
+template<typename K>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare, Alloc>::internalLowerBound(const K& key) const{
+    Node<Key, Value>* candidate = nullptr;
     Node<Key, Value>* current = root_;
-    bool found_node = false;
 
-    if(current == nullptr){
-        return internal_find;
+    while(current != nullptr){
+        if(compare_(current -> getKey(), key)){
+            current = current -> getRight();
+        }
+        else{
+            candidate = current;
+            current = current -> getLeft();
+        }
+    }
+    return candidate;
+}
+
+/**
+* Calls visit(node) for every node with lo <= key < hi, in order, until
+* it returns false. The first descent pushes every node on the way to lo
+* that is not less than lo; after that each node popped is the next in
+* order, and the left spine of its right subtree is pushed behind it.
+* The next node is prefetched before visit runs, so its cache miss
+* overlaps with the work on the current one.
+*/
+template<typename Key, typename Value, typename Compare, typename Alloc>
+template<typename Visitor>
+void BinarySearchTree<Key, Value, Compare, Alloc>::walkRange(const Key& lo, const Key& hi, Visitor& visit) const{
+    if(!compare_(lo, hi)){
+        return;
+    }
+
+    NodeStack stack;
+    Node<Key, Value>* current = root_;
+    while(current != nullptr){
+        if(compare_(current -> getKey(), lo)){
+            current = current -> getRight();
+        }
+        else{
+            stack.push(current);
+            current = current -> getLeft();
+        }
     }
 
-    while(found_node == false){
-        Key current_key = current -> getKey();
-        
-        if(key == current_key){
-            internal_find = current;
-            found_node = true;
+    while(!stack.empty()){
+        Node<Key, Value>* node = stack.pop();
+        if(!compare_(node -> getKey(), hi)){
+            return;
+        }
+        for(current = node -> getRight(); current != nullptr; current = current -> getLeft()){
+            stack.push(current);
         }
-        else if(key < current_key){
-            if(hasLeftChild(current)){
-                current = current -> getLeft();
+        if(!stack.empty()){
+            prefetchNode(stack.top());
+        }
+        if(!visit(node)){
+            return;
+        }
+    }
+}
+
+/**
+* Helper function to find the first node whose key is greater than
+* key, or NULL.
+*/
+template<typename Key, typename Value, typename Compare, typename Alloc>
+template<typename K>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare, Alloc>::internalUpperBound(const K& key) const{
+    Node<Key, Value>* candidate = nullptr;
+    Node<Key, Value>* current = root_;
+
+    while(current != nullptr){
+        if(compare_(key, current -> getKey())){
+            candidate = current;
+            current = current -> getLeft();
+        }
+        else{
+            current = current -> getRight();
+        }
+    }
+    return candidate;
+}
+
+/**
+ * Return true iff the BST is balanced. O(n), see validate().
+ * A tree that fails validation is never reported as balanced, since
+ * validate() stops at the first error without looking at the rest.
+ */
+template<typename Key, typename Value, typename Compare, typename Alloc>
+bool BinarySearchTree<Key, Value, Compare, Alloc>::isBalanced() const{
+    TreeStats stats = validate();
+    return stats.valid && stats.balanced;
+}
+
+/**
+* Checks the whole tree in one O(n) pass and gathers its shape: every
+* child must point back at its parent, the keys must be strictly
+* increasing in order, and checkNode must accept every node (an AVLTree
+* checks the stored balances there). The walk keeps its own stack
+* instead of recursing, so a degenerate tree cannot overflow the call
+* stack, and stops at the first problem.
+*/
+template<typename Key, typename Value, typename Compare, typename Alloc>
+typename BinarySearchTree<Key, Value, Compare, Alloc>::TreeStats
+BinarySearchTree<Key, Value, Compare, Alloc>::validate() const{
+
+    TreeStats stats = { true, nullptr, 0, 0, true, std::vector<std::size_t>() };
+    if(root_ == nullptr){
+        return stats;
+    }
+    if(root_ -> getParent() != nullptr){
+        stats.valid = false;
+        stats.error = "the root has a parent";
+        return stats;
+    }
+
+    //a node is on the stack while its subtree is being walked; state says
+    //whether its left side, its right side, or neither is done
+    struct Frame{
+        Node<Key, Value>* node;
+        int depth;
+        int left_height;
+        int state;
+    };
+    std::vector<Frame> stack;
+    Frame root_frame = { root_, 0, 0, 0 };
+    stack.push_back(root_frame);
+    Node<Key, Value>* previous = nullptr;
+    int child_height = 0;
+
+    while(!stack.empty()){
+        Frame& frame = stack.back();
+        Node<Key, Value>* node = frame.node;
+
+        if(frame.state == 0){
+            frame.state = 1;
+            ++stats.count;
+            if(stats.depth_counts.size() <= static_cast<std::size_t>(frame.depth)){
+                stats.depth_counts.resize(frame.depth + 1, 0);
             }
-            else{
-                found_node = true;
+            ++stats.depth_counts[frame.depth];
+
+            Node<Key, Value>* left = node -> getLeft();
+            if(left != nullptr){
+                if(left -> getParent() != node){
+                    stats.valid = false;
+                    stats.error = "a left child does not point back at its parent";
+                    return stats;
+                }
+                Frame left_frame = { left, frame.depth + 1, 0, 0 };
+                stack.push_back(left_frame);
+                continue;
             }
+            child_height = 0;
         }
-        else if(key > current_key){
-            if(hasRightChild(current)){
-                current = current -> getRight();
+
+        if(frame.state == 1){
+            frame.state = 2;
+            frame.left_height = child_height;
+            if(previous != nullptr && !compare_(previous -> getKey(), node -> getKey())){
+                stats.valid = false;
+                stats.error = "the keys are out of order";
+                return stats;
             }
-            else{
-                found_node = true;
+            previous = node;
+
+            Node<Key, Value>* right = node -> getRight();
+            if(right != nullptr){
+                if(right -> getParent() != node){
+                    stats.valid = false;
+                    stats.error = "a right child does not point back at its parent";
+                    return stats;
+                }
+                Frame right_frame = { right, frame.depth + 1, 0, 0 };
+                stack.push_back(right_frame);
+                continue;
             }
+            child_height = 0;
+        }
+
+        int left_height = frame.left_height;
+        int right_height = child_height;
+        if(left_height - right_height > 1 || right_height - left_height > 1){
+            stats.balanced = false;
+        }
+        const char* error = checkNode(node, left_height, right_height);
+        if(error != nullptr){
+            stats.valid = false;
+            stats.error = error;
+            return stats;
         }
+        child_height = 1 + std::max(left_height, right_height);
+        stack.pop_back();
     }
-    return internal_find;
-}
 
-/**
- * Return true iff the BST is balanced.
- */
-template<typename Key, typename Value>
-bool BinarySearchTree<Key, Value>::isBalanced() const{
-    return isBalancedHelper(root_);
+    stats.height = child_height;
+    return stats;
 }
 
 
 
-template<typename Key, typename Value>
-void BinarySearchTree<Key, Value>::nodeSwap( Node<Key,Value>* n1, Node<Key,Value>* n2){
+template<typename Key, typename Value, typename Compare, typename Alloc>
+void BinarySearchTree<Key, Value, Compare, Alloc>::nodeSwap( Node<Key,Value>* n1, Node<Key,Value>* n2){
 
     if((n1 == n2) || (n1 == NULL) || (n2 == NULL) ) {
         return;
@@ -801,9 +2001,32 @@ void BinarySearchTree<Key, Value>::nodeSwap( Node<Key,Value>* n1, Node<Key,Value
 
 }
 
-template<typename Key, typename Value>
+/**
+* Returns an iterator at current, for derived trees, which cannot use the
+* iterator's constructor directly.
+*/
+template<typename Key, typename Value, typename Compare, typename Alloc>
+typename BinarySearchTree<Key, Value, Compare, Alloc>::iterator
+BinarySearchTree<Key, Value, Compare, Alloc>::makeIterator(Node<Key, Value>* current) const{
+    return iterator(current, this);
+}
+
+/**
+* Asks the CPU to start loading a node into cache. A no-op on compilers
+* without __builtin_prefetch.
+*/
+template<typename Key, typename Value, typename Compare, typename Alloc>
+void BinarySearchTree<Key, Value, Compare, Alloc>::prefetchNode(const Node<Key, Value>* current){
+#if defined(__GNUC__)
+    __builtin_prefetch(current);
+#else
+    (void)current;
+#endif
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc>
 Node<Key, Value>*
-BinarySearchTree<Key, Value>::getSmallestNodeSubtree(Node<Key, Value>* current){
+BinarySearchTree<Key, Value, Compare, Alloc>::getSmallestNodeSubtree(Node<Key, Value>* current){
     if(current == nullptr){
         return nullptr;
     }
@@ -814,9 +2037,12 @@ BinarySearchTree<Key, Value>::getSmallestNodeSubtree(Node<Key, Value>* current){
     return temp;
 }
 
-template<typename Key, typename Value>
+template<typename Key, typename Value, typename Compare, typename Alloc>
 Node<Key, Value>*
-BinarySearchTree<Key, Value>::getLargestNodeSubtree(Node<Key, Value>* current){
+BinarySearchTree<Key, Value, Compare, Alloc>::getLargestNodeSubtree(Node<Key, Value>* current){
+    if(current == nullptr){
+        return nullptr;
+    }
     Node<Key, Value>* temp = current;
     while(hasRightChild(temp)){
         temp = temp -> getRight();
@@ -824,8 +2050,8 @@ BinarySearchTree<Key, Value>::getLargestNodeSubtree(Node<Key, Value>* current){
     return temp;
 }
 
-template<typename Key, typename Value>
-void BinarySearchTree<Key, Value>::clear_helper(Node<Key, Value>* current){
+template<typename Key, typename Value, typename Compare, typename Alloc>
+void BinarySearchTree<Key, Value, Compare, Alloc>::clear_helper(Node<Key, Value>* current){
 
     if(current != nullptr){
 
@@ -835,58 +2061,441 @@ void BinarySearchTree<Key, Value>::clear_helper(Node<Key, Value>* current){
         Node<Key, Value>* right_child = current -> getRight();
         clear_helper(right_child);
 
-        delete current;
+        destroyNode(current);
     }
 }
 
-template<typename Key, typename Value>
-int BinarySearchTree<Key, Value>::getHeight(Node<Key, Value>* current) const{
+/**
+* Walks down from the root looking for key. Returns its node if it is in
+* the tree. Otherwise returns NULL, and parent/left tell where a node for
+* key would be attached (parent is NULL if the tree is empty).
+* Makes one comparison per level, the same way internalFind does.
+*/
+template<typename Key, typename Value, typename Compare, typename Alloc>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare, Alloc>::findSlot(const Key& key,
+                                                              Node<Key, Value>*& parent,
+                                                              bool& left) const{
+    return findSlotBelow(root_, key, parent, left);
+}
 
-    if(current == nullptr){
-        return 0;
+/**
+* findSlot for the subtree under start, which must be the root or a node
+* whose subtree is known to be where key belongs.
+*/
+template<typename Key, typename Value, typename Compare, typename Alloc>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare, Alloc>::findSlotBelow(Node<Key, Value>* start,
+                                                                   const Key& key,
+                                                                   Node<Key, Value>*& parent,
+                                                                   bool& left) const{
+    Node<Key, Value>* candidate = nullptr;
+    Node<Key, Value>* current = start;
+    parent = nullptr;
+    left = false;
+
+    while(current != nullptr){
+        parent = current;
+        left = !compare_(current -> getKey(), key);
+        if(left){
+            candidate = current;
+            current = current -> getLeft();
+        }
+        else{
+            current = current -> getRight();
+        }
     }
 
-    int left_height = getHeight(current -> getLeft());
-    int right_height = getHeight(current -> getRight());
-    int larger_height = std::max(left_height, right_height);
-    int height = larger_height + 1;
+    if(candidate != nullptr && !compare_(key, candidate -> getKey())){
+        return candidate;
+    }
+    return nullptr;
+}
 
-    return height;
+/**
+* findSlot for a hinted insert. hint is the node the key is expected next
+* to, or NULL for end(), meaning after the largest node. If the key
+* belongs between hint and its neighbour on that side, one of the two
+* has a free child there: hint's own left (right) child if it has none,
+* else the neighbour, which is then the largest (smallest) node of hint's
+* left (right) subtree. The neighbour is found with prevNode/nextNode,
+* which is one load in a threaded tree. Otherwise falls back to findSlot.
+*/
+template<typename Key, typename Value, typename Compare, typename Alloc>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare, Alloc>::findSlotNear(Node<Key, Value>* hint,
+                                                                  const Key& key,
+                                                                  Node<Key, Value>*& parent,
+                                                                  bool& left) const{
+    if(hint == nullptr){
+        // only the right spine is walked, without comparing anything
+        Node<Key, Value>* largest = getLargestNodeSubtree(root_);
+        if(largest == nullptr || compare_(largest -> getKey(), key)){
+            parent = largest;
+            left = false;
+            return nullptr;
+        }
+    }
+    else if(compare_(key, hint -> getKey())){
+        Node<Key, Value>* before = prevNode(hint);
+        if(before == nullptr || compare_(before -> getKey(), key)){
+            left = hint -> getLeft() == nullptr;
+            parent = left ? hint : before;
+            return nullptr;
+        }
+    }
+    else if(compare_(hint -> getKey(), key)){
+        Node<Key, Value>* after = nextNode(hint);
+        if(after == nullptr || compare_(key, after -> getKey())){
+            left = hint -> getRight() != nullptr;
+            parent = left ? after : hint;
+            return nullptr;
+        }
+    }
+    else{
+        return hint;
+    }
+    return findSlotFrom(hint, key, parent, left);
 }
 
-template<typename Key, typename Value>
-bool BinarySearchTree<Key, Value>::isBalancedHelper(Node<Key, Value>* current) const{
+/**
+* findSlot starting from finger instead of the root (or from the root if
+* finger is NULL). The keys of a subtree lie between those of the nearest
+* ancestors it hangs to the right and to the left of. Climbing towards a
+* smaller key, the ancestors the climb comes up to the left of are all
+* bigger than finger, so the first ancestor smaller than key is the one
+* that bounds the subtree below it, and key belongs in that subtree.
+* Likewise for a bigger key. A climb that meets key returns that node.
+*/
+template<typename Key, typename Value, typename Compare, typename Alloc>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare, Alloc>::findSlotFrom(Node<Key, Value>* finger,
+                                                                  const Key& key,
+                                                                  Node<Key, Value>*& parent,
+                                                                  bool& left) const{
+    if(finger == nullptr){
+        return findSlot(key, parent, left);
+    }
 
-    bool temp = false; 
+    Node<Key, Value>* current = finger;
+    Node<Key, Value>* above = current -> getParent();
+    if(compare_(key, finger -> getKey())){
+        while(above != nullptr && !compare_(above -> getKey(), key)){
+            if(!compare_(key, above -> getKey())){
+                return above;
+            }
+            current = above;
+            above = current -> getParent();
+        }
+    }
+    else if(compare_(finger -> getKey(), key)){
+        while(above != nullptr && !compare_(key, above -> getKey())){
+            if(!compare_(above -> getKey(), key)){
+                return above;
+            }
+            current = above;
+            above = current -> getParent();
+        }
+    }
+    else{
+        return finger;
+    }
+    return findSlotBelow(current, key, parent, left);
+}
 
-    if(current == nullptr){
-        temp = true;
+/**
+* The body of both inserts: overwrites the value if key is already in
+* the tree, otherwise adds a new node. The value is only copied or moved
+* once, straight into its node.
+*/
+template<typename Key, typename Value, typename Compare, typename Alloc>
+template<typename K, typename V>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare, Alloc>::insertItem(K&& key, V&& value){
+    Node<Key, Value>* parent = nullptr;
+    bool left = false;
+    Node<Key, Value>* found = findSlot(key, parent, left);
+    return placeItem(found, parent, left, std::forward<K>(key), std::forward<V>(value));
+}
+
+/**
+* Finishes an insert once the slot is known: found is the node with the
+* key, or NULL to add one below parent on the given side.
+*/
+template<typename Key, typename Value, typename Compare, typename Alloc>
+template<typename K, typename V>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare, Alloc>::placeItem(Node<Key, Value>* found,
+                                                               Node<Key, Value>* parent, bool left,
+                                                               K&& key, V&& value){
+    if(found != nullptr){
+        found -> setValue(std::forward<V>(value));
+        valueChanged(found);
+        return found;
+    }
+    Node<Key, Value>* new_node = makeNode(Key(std::forward<K>(key)), Value(std::forward<V>(value)), parent);
+    linkNode(new_node, parent, left);
+    return new_node;
+}
+
+/**
+* Creates a node for this kind of tree, moving the key and value in.
+* Trees with their own node type override this.
+*/
+template<typename Key, typename Value, typename Compare, typename Alloc>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare, Alloc>::makeNode(Key&& key, Value&& value,
+                                                              Node<Key, Value>* parent){
+    return createNode(std::move(key), std::move(value), parent);
+}
+
+/**
+* Attaches a new node as the left or right child of parent (or as the
+* root if parent is NULL). Balanced trees override this to rebalance.
+*/
+template<typename Key, typename Value, typename Compare, typename Alloc>
+void BinarySearchTree<Key, Value, Compare, Alloc>::linkNode(Node<Key, Value>* node,
+                                                 Node<Key, Value>* parent, bool left){
+    if(parent == nullptr){
+        root_ = node;
+    }
+    else if(left){
+        parent -> setLeft(node);
     }
     else{
-        Node<Key, Value>* left_child = current -> getLeft();
-        Node<Key, Value>* right_child = current -> getRight();
+        parent -> setRight(node);
+    }
+    thread(node, parent, left);
+}
 
-        int left_height = getHeight(left_child);
-        int right_height = getHeight(right_child);
+/**
+* Constructs a node of the given type in memory from the allocator.
+*/
+template<typename Key, typename Value, typename Compare, typename Alloc>
+template<typename NodeType, typename K, typename V>
+NodeType* BinarySearchTree<Key, Value, Compare, Alloc>::createNode(K&& key, V&& value, NodeType* parent){
+    void* memory = allocator_.allocate(sizeof(NodeType), alignof(NodeType));
+    try{
+        return new (memory) NodeType(std::forward<K>(key), std::forward<V>(value), parent);
+    }
+    catch(...){
+        allocator_.deallocate(memory);
+        throw;
+    }
+}
 
-        int difference = abs(right_height - left_height);
-        bool diff = false;
-        if(difference <= 1){
-            diff = true;
-        }
+/**
+* Called by assignSorted once both subtrees of current are built, with
+* their heights. Trees that keep per-node balance information override
+* this to fill it in; a plain BinarySearchTree keeps none.
+*/
+template<typename Key, typename Value, typename Compare, typename Alloc>
+void BinarySearchTree<Key, Value, Compare, Alloc>::finishBuiltNode(Node<Key, Value>* /*current*/,
+                                                        int /*left_height*/, int /*right_height*/){
 
-        bool left_balance = isBalancedHelper(left_child);
-        bool right_balance = isBalancedHelper(right_child);
+}
 
-        if(diff && left_balance && right_balance){
-            temp = true;
+/**
+* Replaces the contents of the tree with items, which must be sorted with
+* no two equal keys, moving them into new nodes. The new nodes are built
+* next to the old ones, which are only destroyed once all of them are made.
+* If a node cannot be made the new ones are destroyed, the tree is left as
+* it was and the exception rethrown.
+*/
+template<typename Key, typename Value, typename Compare, typename Alloc>
+void BinarySearchTree<Key, Value, Compare, Alloc>::rebuildSorted(std::vector<std::pair<Key, Value> >& items){
+    Node<Key, Value>* old_root = root_;
+    root_ = nullptr;
+    try{
+        buildSorted(items, 0, items.size(), nullptr, false);
+    }
+    catch(...){
+        clear_helper(root_);
+        root_ = old_root;
+        throw;
+    }
+    clear_helper(old_root);
+    rethread();
+}
+
+/**
+* Returns true if the tree has more than limit nodes. Stops counting as
+* soon as it knows, so the cost is O(limit) however big the tree is.
+*/
+template<typename Key, typename Value, typename Compare, typename Alloc>
+bool BinarySearchTree<Key, Value, Compare, Alloc>::hasMoreNodesThan(std::size_t limit) const{
+    std::size_t count = 0;
+    std::vector<Node<Key, Value>*> stack;
+    if(root_ != nullptr){
+        stack.push_back(root_);
+    }
+    while(!stack.empty()){
+        Node<Key, Value>* current = stack.back();
+        stack.pop_back();
+        if(++count > limit){
+            return true;
+        }
+        if(hasRightChild(current)){
+            stack.push_back(current -> getRight());
+        }
+        if(hasLeftChild(current)){
+            stack.push_back(current -> getLeft());
         }
     }
-    return temp;
+    return false;
 }
 
-template<typename Key, typename Value>
-bool BinarySearchTree<Key, Value>::isRoot(Node<Key, Value>* current){
+/**
+* Builds the items in [lo, hi) into a balanced subtree attached to parent
+* on the given side (or as the root if parent is NULL), moving them out
+* of items, and returns its height. The middle item goes at the root, so
+* the right subtree is never smaller than the left one. Each node is
+* linked in before its children are built, so whatever was built stays
+* reachable from root_ if makeNode throws.
+*/
+template<typename Key, typename Value, typename Compare, typename Alloc>
+int BinarySearchTree<Key, Value, Compare, Alloc>::buildSorted(std::vector<std::pair<Key, Value> >& items,
+                                                   std::size_t lo, std::size_t hi,
+                                                   Node<Key, Value>* parent, bool left){
+    if(lo >= hi){
+        return 0;
+    }
+
+    std::size_t mid = lo + (hi - lo) / 2;
+    Node<Key, Value>* node = makeNode(std::move(items[mid].first), std::move(items[mid].second), parent);
+    if(parent == nullptr){
+        root_ = node;
+    }
+    else if(left){
+        parent -> setLeft(node);
+    }
+    else{
+        parent -> setRight(node);
+    }
+
+    int left_height = buildSorted(items, lo, mid, node, true);
+    int right_height = buildSorted(items, mid + 1, hi, node, false);
+    finishBuiltNode(node, left_height, right_height);
+    return 1 + std::max(left_height, right_height);
+}
+
+/**
+* The node after current in key order, or NULL. Only called by the
+* iterators when threaded_ is set.
+*/
+template<typename Key, typename Value, typename Compare, typename Alloc>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare, Alloc>::nextNode(Node<Key, Value>* current) const{
+    return successor(current);
+}
+
+/**
+* The node before current in key order, or NULL.
+*/
+template<typename Key, typename Value, typename Compare, typename Alloc>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare, Alloc>::prevNode(Node<Key, Value>* current) const{
+    return predecessor(current);
+}
+
+/**
+* Makes next follow prev in the in-order links. Either may be NULL, which
+* makes the other one the first or last node. Does nothing unless the
+* tree keeps links.
+*/
+template<typename Key, typename Value, typename Compare, typename Alloc>
+void BinarySearchTree<Key, Value, Compare, Alloc>::threadNodes(Node<Key, Value>* /*prev*/,
+                                                    Node<Key, Value>* /*next*/){
+
+}
+
+/**
+* Puts a node just linked in as a leaf under parent into the in-order
+* links. A left child comes right before its parent and a right child
+* right after it.
+*/
+template<typename Key, typename Value, typename Compare, typename Alloc>
+void BinarySearchTree<Key, Value, Compare, Alloc>::thread(Node<Key, Value>* current,
+                                               Node<Key, Value>* parent, bool left){
+    if(!threaded_){
+        return;
+    }
+    if(parent == nullptr){
+        threadNodes(nullptr, current);
+        threadNodes(current, nullptr);
+    }
+    else if(left){
+        threadNodes(prevNode(parent), current);
+        threadNodes(current, parent);
+    }
+    else{
+        threadNodes(current, nextNode(parent));
+        threadNodes(parent, current);
+    }
+}
+
+/**
+* Takes current out of the in-order links before it is destroyed.
+*/
+template<typename Key, typename Value, typename Compare, typename Alloc>
+void BinarySearchTree<Key, Value, Compare, Alloc>::unthread(Node<Key, Value>* current){
+    if(threaded_){
+        threadNodes(prevNode(current), nextNode(current));
+    }
+}
+
+/**
+* Relinks every node to its neighbours with one in-order walk, after the
+* tree has been rebuilt wholesale. Does nothing unless the tree keeps
+* links.
+*/
+template<typename Key, typename Value, typename Compare, typename Alloc>
+void BinarySearchTree<Key, Value, Compare, Alloc>::rethread(){
+    if(!threaded_){
+        return;
+    }
+    Node<Key, Value>* prev = nullptr;
+    for(Node<Key, Value>* current = getSmallestNode(); current != nullptr; current = successor(current)){
+        threadNodes(prev, current);
+        prev = current;
+    }
+    threadNodes(prev, nullptr);
+}
+
+/**
+* Called after the tree overwrites the value of an existing node. Trees
+* that keep data computed from the values override this to refresh it.
+*/
+template<typename Key, typename Value, typename Compare, typename Alloc>
+void BinarySearchTree<Key, Value, Compare, Alloc>::valueChanged(Node<Key, Value>* /*current*/){
+
+}
+
+/**
+* True if destroying a node does nothing but hand back its memory, which
+* lets clear() skip the walk. Trees whose nodes add members with
+* destructors of their own override this.
+*/
+template<typename Key, typename Value, typename Compare, typename Alloc>
+bool BinarySearchTree<Key, Value, Compare, Alloc>::trivialNodes() const{
+    return std::is_trivially_destructible<std::pair<const Key, Value> >::value;
+}
+
+/**
+* Destroys a node and hands its memory back to the allocator.
+* Trees with their own node type override this to run the
+* right destructor, since Node's destructor is not virtual.
+*/
+template<typename Key, typename Value, typename Compare, typename Alloc>
+void BinarySearchTree<Key, Value, Compare, Alloc>::destroyNode(Node<Key, Value>* current){
+    current -> ~Node();
+    allocator_.deallocate(current);
+}
+
+/**
+* Called by validate() on every node once the heights of its subtrees are
+* known. Returns NULL if the node is fine, or what is wrong with it. Trees
+* that keep data in their nodes override this to check it.
+*/
+template<typename Key, typename Value, typename Compare, typename Alloc>
+const char* BinarySearchTree<Key, Value, Compare, Alloc>::checkNode(Node<Key, Value>* /*current*/,
+                                                         int /*left_height*/, int /*right_height*/) const{
+    return nullptr;
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc>
+bool BinarySearchTree<Key, Value, Compare, Alloc>::isRoot(Node<Key, Value>* current){
     bool temp = false;
     if(current -> getParent() == nullptr){
         temp = true;
@@ -894,15 +2503,15 @@ bool BinarySearchTree<Key, Value>::isRoot(Node<Key, Value>* current){
     return temp;
 }
 
-template<typename Key, typename Value>
-bool BinarySearchTree<Key, Value>::isLeaf(Node<Key, Value>* current){
+template<typename Key, typename Value, typename Compare, typename Alloc>
+bool BinarySearchTree<Key, Value, Compare, Alloc>::isLeaf(Node<Key, Value>* current){
     bool left = hasLeftChild(current);
     bool right = hasRightChild(current);
     return (!left && !right);
 }
 
-template<typename Key, typename Value>
-bool BinarySearchTree<Key, Value>::hasLeftChild(Node<Key, Value>* current){
+template<typename Key, typename Value, typename Compare, typename Alloc>
+bool BinarySearchTree<Key, Value, Compare, Alloc>::hasLeftChild(Node<Key, Value>* current){
     bool temp = false;
     if(current -> getLeft() != nullptr){
         temp = true;
@@ -910,8 +2519,8 @@ bool BinarySearchTree<Key, Value>::hasLeftChild(Node<Key, Value>* current){
     return temp;
 }
 
-template<typename Key, typename Value>
-bool BinarySearchTree<Key, Value>::hasRightChild(Node<Key, Value>* current){
+template<typename Key, typename Value, typename Compare, typename Alloc>
+bool BinarySearchTree<Key, Value, Compare, Alloc>::hasRightChild(Node<Key, Value>* current){
     bool temp = false;
     if(current -> getRight() != nullptr){
         temp = true;
@@ -919,15 +2528,15 @@ bool BinarySearchTree<Key, Value>::hasRightChild(Node<Key, Value>* current){
     return temp;
 }
 
-template<typename Key, typename Value>
-bool BinarySearchTree<Key, Value>::hasChildren(Node<Key, Value>* current){
+template<typename Key, typename Value, typename Compare, typename Alloc>
+bool BinarySearchTree<Key, Value, Compare, Alloc>::hasChildren(Node<Key, Value>* current){
     bool left = hasLeftChild(current);
     bool right = hasRightChild(current);
     return (left || right);
 }
 
-template<typename Key, typename Value>
-bool BinarySearchTree<Key, Value>::hasOneChild(Node<Key, Value>* current){
+template<typename Key, typename Value, typename Compare, typename Alloc>
+bool BinarySearchTree<Key, Value, Compare, Alloc>::hasOneChild(Node<Key, Value>* current){
     bool left = hasLeftChild(current);
     bool right = hasRightChild(current);
     bool left_and_not_right = (left && !right);
@@ -935,15 +2544,15 @@ bool BinarySearchTree<Key, Value>::hasOneChild(Node<Key, Value>* current){
     return (left_and_not_right || right_and_not_left);
 }
 
-template<typename Key, typename Value>
-bool BinarySearchTree<Key, Value>::hasTwoChildren(Node<Key, Value>* current){
+template<typename Key, typename Value, typename Compare, typename Alloc>
+bool BinarySearchTree<Key, Value, Compare, Alloc>::hasTwoChildren(Node<Key, Value>* current){
     bool left = hasLeftChild(current);
     bool right = hasRightChild(current);
     return (left && right);
 }
 
-template<typename Key, typename Value>
-bool BinarySearchTree<Key, Value>::isLeftChild(Node<Key, Value>* current, 
+template<typename Key, typename Value, typename Compare, typename Alloc>
+bool BinarySearchTree<Key, Value, Compare, Alloc>::isLeftChild(Node<Key, Value>* current, 
                                                 Node<Key, Value>* parent){
     bool temp = false;
     if(parent -> getLeft() == current){
@@ -952,8 +2561,8 @@ bool BinarySearchTree<Key, Value>::isLeftChild(Node<Key, Value>* current,
     return temp;
 }
 
-template<typename Key, typename Value>
-bool BinarySearchTree<Key, Value>::isRightChild(Node<Key, Value>* current, 
+template<typename Key, typename Value, typename Compare, typename Alloc>
+bool BinarySearchTree<Key, Value, Compare, Alloc>::isRightChild(Node<Key, Value>* current, 
                                                 Node<Key, Value>* parent){
     bool temp = false;
     if(parent -> getRight() == current){
@@ -0,0 +1,852 @@
+#ifndef BTREE_H
+#define BTREE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <type_traits>
+#include <utility>
+#include "node_pool.h"
+
+#if defined(__SSE2__) || defined(__AVX__)
+#include <immintrin.h>
+#endif
+
+/**
+* Finds how many of the n sorted keys are less than key. This is the
+* search done inside every BTree node. The general version is a binary
+* search with Compare; the specializations below scan the keys with
+* SIMD compares for arithmetic keys ordered by std::less.
+*/
+template <typename Key, typename Compare>
+struct BTreeKeySearch{
+    static unsigned countLess(const Key* keys, unsigned n, const Key& key, const Compare& compare){
+        unsigned lo = 0;
+        unsigned hi = n;
+        while(lo < hi){
+            unsigned mid = lo + (hi - lo) / 2;
+            if(compare(keys[mid], key)){
+                lo = mid + 1;
+            }
+            else{
+                hi = mid;
+            }
+        }
+        return lo;
+    }
+};
+
+/**
+* Number of lanes set in a compare mask. Since the keys are sorted,
+* the lanes that compared less always come first.
+*/
+inline unsigned btreeMaskCount(unsigned mask){
+#if defined(__GNUC__)
+    return static_cast<unsigned>(__builtin_popcount(mask));
+#else
+    unsigned count = 0;
+    while(mask & 1){
+        ++count;
+        mask >>= 1;
+    }
+    return count;
+#endif
+}
+
+/**
+* SIMD search over 32-bit integer keys.
+*/
+template <>
+struct BTreeKeySearch<std::int32_t, std::less<std::int32_t> >{
+    static unsigned countLess(const std::int32_t* keys, unsigned n, const std::int32_t& key,
+                              const std::less<std::int32_t>&){
+        unsigned i = 0;
+#if defined(__AVX2__)
+        const __m256i target = _mm256_set1_epi32(key);
+        for(; i + 8 <= n; i += 8){
+            __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(keys + i));
+            unsigned mask = static_cast<unsigned>(
+                _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(target, block))));
+            if(mask != 0xFFu){
+                return i + btreeMaskCount(mask);
+            }
+        }
+#elif defined(__SSE2__)
+        const __m128i target = _mm_set1_epi32(key);
+        for(; i + 4 <= n; i += 4){
+            __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(keys + i));
+            unsigned mask = static_cast<unsigned>(
+                _mm_movemask_ps(_mm_castsi128_ps(_mm_cmplt_epi32(block, target))));
+            if(mask != 0xFu){
+                return i + btreeMaskCount(mask);
+            }
+        }
+#endif
+        while(i < n && keys[i] < key){
+            ++i;
+        }
+        return i;
+    }
+};
+
+/**
+* SIMD search over 64-bit integer keys. 64-bit compares need AVX2 or SSE4.2.
+*/
+template <>
+struct BTreeKeySearch<std::int64_t, std::less<std::int64_t> >{
+    static unsigned countLess(const std::int64_t* keys, unsigned n, const std::int64_t& key,
+                              const std::less<std::int64_t>&){
+        unsigned i = 0;
+#if defined(__AVX2__)
+        const __m256i target = _mm256_set1_epi64x(key);
+        for(; i + 4 <= n; i += 4){
+            __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(keys + i));
+            unsigned mask = static_cast<unsigned>(
+                _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(target, block))));
+            if(mask != 0xFu){
+                return i + btreeMaskCount(mask);
+            }
+        }
+#elif defined(__SSE4_2__)
+        const __m128i target = _mm_set1_epi64x(key);
+        for(; i + 2 <= n; i += 2){
+            __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(keys + i));
+            unsigned mask = static_cast<unsigned>(
+                _mm_movemask_pd(_mm_castsi128_pd(_mm_cmpgt_epi64(target, block))));
+            if(mask != 0x3u){
+                return i + btreeMaskCount(mask);
+            }
+        }
+#endif
+        while(i < n && keys[i] < key){
+            ++i;
+        }
+        return i;
+    }
+};
+
+/**
+* SIMD search over float keys.
+*/
+template <>
+struct BTreeKeySearch<float, std::less<float> >{
+    static unsigned countLess(const float* keys, unsigned n, const float& key,
+                              const std::less<float>&){
+        unsigned i = 0;
+#if defined(__AVX__)
+        const __m256 target = _mm256_set1_ps(key);
+        for(; i + 8 <= n; i += 8){
+            __m256 block = _mm256_loadu_ps(keys + i);
+            unsigned mask = static_cast<unsigned>(_mm256_movemask_ps(_mm256_cmp_ps(block, target, _CMP_LT_OQ)));
+            if(mask != 0xFFu){
+                return i + btreeMaskCount(mask);
+            }
+        }
+#elif defined(__SSE2__)
+        const __m128 target = _mm_set1_ps(key);
+        for(; i + 4 <= n; i += 4){
+            __m128 block = _mm_loadu_ps(keys + i);
+            unsigned mask = static_cast<unsigned>(_mm_movemask_ps(_mm_cmplt_ps(block, target)));
+            if(mask != 0xFu){
+                return i + btreeMaskCount(mask);
+            }
+        }
+#endif
+        while(i < n && keys[i] < key){
+            ++i;
+        }
+        return i;
+    }
+};
+
+/**
+* SIMD search over double keys.
+*/
+template <>
+struct BTreeKeySearch<double, std::less<double> >{
+    static unsigned countLess(const double* keys, unsigned n, const double& key,
+                              const std::less<double>&){
+        unsigned i = 0;
+#if defined(__AVX__)
+        const __m256d target = _mm256_set1_pd(key);
+        for(; i + 4 <= n; i += 4){
+            __m256d block = _mm256_loadu_pd(keys + i);
+            unsigned mask = static_cast<unsigned>(_mm256_movemask_pd(_mm256_cmp_pd(block, target, _CMP_LT_OQ)));
+            if(mask != 0xFu){
+                return i + btreeMaskCount(mask);
+            }
+        }
+#elif defined(__SSE2__)
+        const __m128d target = _mm_set1_pd(key);
+        for(; i + 2 <= n; i += 2){
+            __m128d block = _mm_loadu_pd(keys + i);
+            unsigned mask = static_cast<unsigned>(_mm_movemask_pd(_mm_cmplt_pd(block, target)));
+            if(mask != 0x3u){
+                return i + btreeMaskCount(mask);
+            }
+        }
+#endif
+        while(i < n && keys[i] < key){
+            ++i;
+        }
+        return i;
+    }
+};
+
+/**
+* A B+ tree with the same insert/remove/find/iterator surface as
+* BinarySearchTree. Each node holds up to CAPACITY keys in a sorted
+* array, sized so that the keys of one node span a few cache lines,
+* which replaces one cache miss per comparison with one per node. All
+* items live in the leaves, which are linked in order for iteration.
+*
+* Key and Value must be default constructible and assignable, since
+* the nodes hold them in plain arrays. Nodes come from two allocators
+* (leaves and inner nodes), NodePool by default.
+*/
+template <typename Key, typename Value, typename Compare = std::less<Key>, typename Alloc = NodePool>
+class BTree{
+
+public:
+    // keys per node: about 256 bytes of keys, and never fewer than 4
+    static const unsigned CAPACITY = sizeof(Key) * 4 > 256 ? 4 : 256 / sizeof(Key);
+    // every node but the root keeps at least this many keys
+    static const unsigned MIN_KEYS = CAPACITY / 2;
+
+    explicit BTree(const Compare& compare = Compare());
+    ~BTree();
+
+    void insert(const std::pair<const Key, Value>& keyValuePair);
+    void remove(const Key& key);
+    void clear();
+    bool empty() const;
+    std::size_t size() const;
+
+private:
+    struct Leaf;
+
+public:
+    /**
+    * An iterator over the items in key order. Keys and values are kept
+    * in separate arrays, so dereferencing gives a pair of references
+    * rather than a reference to a pair.
+    */
+    class iterator{
+
+    public:
+        typedef std::pair<const Key&, Value&> reference;
+
+        // holds the pair of references so that operator-> has something to point at
+        class pointer{
+        public:
+            explicit pointer(const reference& item) : item_(item){}
+            const reference* operator->() const { return &item_; }
+        private:
+            reference item_;
+        };
+
+        iterator();
+
+        reference operator*() const;
+        pointer operator->() const;
+
+        bool operator==(const iterator& rhs) const;
+        bool operator!=(const iterator& rhs) const;
+
+        iterator& operator++();
+
+    protected:
+        friend class BTree<Key, Value, Compare, Alloc>;
+        iterator(Leaf* leaf, unsigned index);
+        Leaf* leaf_;
+        unsigned index_;
+    };
+
+    iterator begin() const;
+    iterator end() const;
+    iterator find(const Key& key) const;
+
+private:
+    struct NodeBase{
+        unsigned count;
+        bool leaf;
+    };
+    // one spare slot so a node can overflow by one item before it splits
+    struct Leaf : NodeBase{
+        Leaf* prev;
+        Leaf* next;
+        Key keys[CAPACITY + 1];
+        Value values[CAPACITY + 1];
+    };
+    // children[i] holds keys less than keys[i], children[i + 1] the rest
+    struct Inner : NodeBase{
+        Key keys[CAPACITY + 1];
+        NodeBase* children[CAPACITY + 2];
+    };
+
+    unsigned countLess(const NodeBase* node, const Key& key) const;
+    const Key* keysOf(const NodeBase* node) const;
+    unsigned childIndex(const Inner* node, const Key& key) const;
+
+    Leaf* createLeaf();
+    Inner* createInner();
+    void destroyNode(NodeBase* node);
+    void clear_helper(NodeBase* node);
+
+    NodeBase* insert_helper(NodeBase* node, const Key& key, const Value& value, Key& separator);
+    bool remove_helper(NodeBase* node, const Key& key);
+    void fixChild(Inner* parent, unsigned index);
+    void removeFromInner(Inner* node, unsigned index);
+
+    NodeBase* root_;
+    Leaf* first_;
+    std::size_t size_;
+    Compare compare_;
+    Alloc leaf_allocator_;
+    Alloc inner_allocator_;
+};
+
+/*
+  ------------------------------------------------
+  Begin implementations for the BTree::iterator class.
+  ------------------------------------------------
+*/
+
+template<typename Key, typename Value, typename Compare, typename Alloc>
+BTree<Key, Value, Compare, Alloc>::iterator::iterator() : leaf_(nullptr), index_(0){
+
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc>
+BTree<Key, Value, Compare, Alloc>::iterator::iterator(Leaf* leaf, unsigned index) :
+    leaf_(leaf), index_(index){
+
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc>
+typename BTree<Key, Value, Compare, Alloc>::iterator::reference
+BTree<Key, Value, Compare, Alloc>::iterator::operator*() const{
+    return reference(leaf_ -> keys[index_], leaf_ -> values[index_]);
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc>
+typename BTree<Key, Value, Compare, Alloc>::iterator::pointer
+BTree<Key, Value, Compare, Alloc>::iterator::operator->() const{
+    return pointer(**this);
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc>
+bool BTree<Key, Value, Compare, Alloc>::iterator::operator==(const iterator& rhs) const{
+    return leaf_ == rhs.leaf_ && index_ == rhs.index_;
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc>
+bool BTree<Key, Value, Compare, Alloc>::iterator::operator!=(const iterator& rhs) const{
+    return !(*this == rhs);
+}
+
+/**
+* Advances to the next item, moving on to the next leaf when this one runs out.
+*/
+template<typename Key, typename Value, typename Compare, typename Alloc>
+typename BTree<Key, Value, Compare, Alloc>::iterator&
+BTree<Key, Value, Compare, Alloc>::iterator::operator++(){
+    ++index_;
+    if(index_ == leaf_ -> count){
+        leaf_ = leaf_ -> next;
+        index_ = 0;
+    }
+    return *this;
+}
+
+/*
+  ----------------------------------------------
+  End implementations for the BTree::iterator class.
+  ----------------------------------------------
+*/
+
+/*
+  ----------------------------------------
+  Begin implementations for the BTree class.
+  ----------------------------------------
+*/
+
+template<typename Key, typename Value, typename Compare, typename Alloc>
+BTree<Key, Value, Compare, Alloc>::BTree(const Compare& compare) :
+    root_(nullptr), first_(nullptr), size_(0), compare_(compare){
+
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc>
+BTree<Key, Value, Compare, Alloc>::~BTree(){
+    clear();
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc>
+bool BTree<Key, Value, Compare, Alloc>::empty() const{
+    return root_ == nullptr;
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc>
+std::size_t BTree<Key, Value, Compare, Alloc>::size() const{
+    return size_;
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc>
+typename BTree<Key, Value, Compare, Alloc>::iterator
+BTree<Key, Value, Compare, Alloc>::begin() const{
+    return iterator(first_, 0);
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc>
+typename BTree<Key, Value, Compare, Alloc>::iterator
+BTree<Key, Value, Compare, Alloc>::end() const{
+    return iterator(nullptr, 0);
+}
+
+/**
+* Returns an iterator to the item with the given key, or end().
+*/
+template<typename Key, typename Value, typename Compare, typename Alloc>
+typename BTree<Key, Value, Compare, Alloc>::iterator
+BTree<Key, Value, Compare, Alloc>::find(const Key& key) const{
+    NodeBase* current = root_;
+    if(current == nullptr){
+        return end();
+    }
+    while(!current -> leaf){
+        Inner* inner = static_cast<Inner*>(current);
+        current = inner -> children[childIndex(inner, key)];
+    }
+    Leaf* leaf = static_cast<Leaf*>(current);
+    unsigned index = countLess(leaf, key);
+    if(index < leaf -> count && !compare_(key, leaf -> keys[index])){
+        return iterator(leaf, index);
+    }
+    return end();
+}
+
+/**
+* Inserts a pair, overwriting the value if the key is already in the
+* tree, the same as BinarySearchTree::insert.
+*/
+template<typename Key, typename Value, typename Compare, typename Alloc>
+void BTree<Key, Value, Compare, Alloc>::insert(const std::pair<const Key, Value>& keyValuePair){
+
+    if(root_ == nullptr){
+        Leaf* leaf = createLeaf();
+        leaf -> keys[0] = keyValuePair.first;
+        leaf -> values[0] = keyValuePair.second;
+        leaf -> count = 1;
+        root_ = leaf;
+        first_ = leaf;
+        ++size_;
+        return;
+    }
+
+    //if the root split, grow the tree by one level
+    Key separator;
+    NodeBase* sibling = insert_helper(root_, keyValuePair.first, keyValuePair.second, separator);
+    if(sibling != nullptr){
+        Inner* new_root = createInner();
+        new_root -> keys[0] = separator;
+        new_root -> children[0] = root_;
+        new_root -> children[1] = sibling;
+        new_root -> count = 1;
+        root_ = new_root;
+    }
+}
+
+/**
+* Inserts into the subtree at node. If node had to split, returns the
+* new right sibling and sets separator to the smallest key under it,
+* otherwise returns NULL.
+*/
+template<typename Key, typename Value, typename Compare, typename Alloc>
+typename BTree<Key, Value, Compare, Alloc>::NodeBase*
+BTree<Key, Value, Compare, Alloc>::insert_helper(NodeBase* node, const Key& key,
+                                                 const Value& value, Key& separator){
+    if(node -> leaf){
+        Leaf* leaf = static_cast<Leaf*>(node);
+        unsigned index = countLess(leaf, key);
+
+        //if the key is already here, overwrite the value
+        if(index < leaf -> count && !compare_(key, leaf -> keys[index])){
+            leaf -> values[index] = value;
+            return nullptr;
+        }
+
+        for(unsigned i = leaf -> count; i > index; --i){
+            leaf -> keys[i] = leaf -> keys[i - 1];
+            leaf -> values[i] = leaf -> values[i - 1];
+        }
+        leaf -> keys[index] = key;
+        leaf -> values[index] = value;
+        ++leaf -> count;
+        ++size_;
+
+        if(leaf -> count <= CAPACITY){
+            return nullptr;
+        }
+
+        //split the full leaf in half and link the new one in after it
+        Leaf* right = createLeaf();
+        unsigned keep = leaf -> count / 2;
+        for(unsigned i = keep; i < leaf -> count; ++i){
+            right -> keys[i - keep] = leaf -> keys[i];
+            right -> values[i - keep] = leaf -> values[i];
+        }
+        right -> count = leaf -> count - keep;
+        leaf -> count = keep;
+
+        right -> next = leaf -> next;
+        right -> prev = leaf;
+        if(leaf -> next != nullptr){
+            leaf -> next -> prev = right;
+        }
+        leaf -> next = right;
+
+        separator = right -> keys[0];
+        return right;
+    }
+
+    Inner* inner = static_cast<Inner*>(node);
+    unsigned index = childIndex(inner, key);
+    Key child_separator;
+    NodeBase* child_sibling = insert_helper(inner -> children[index], key, value, child_separator);
+    if(child_sibling == nullptr){
+        return nullptr;
+    }
+
+    //the child split, so add its new sibling right after it
+    for(unsigned i = inner -> count; i > index; --i){
+        inner -> keys[i] = inner -> keys[i - 1];
+        inner -> children[i + 1] = inner -> children[i];
+    }
+    inner -> keys[index] = child_separator;
+    inner -> children[index + 1] = child_sibling;
+    ++inner -> count;
+
+    if(inner -> count <= CAPACITY){
+        return nullptr;
+    }
+
+    //split the full inner node, the middle key moves up
+    Inner* right = createInner();
+    unsigned middle = inner -> count / 2;
+    for(unsigned i = middle + 1; i < inner -> count; ++i){
+        right -> keys[i - middle - 1] = inner -> keys[i];
+    }
+    for(unsigned i = middle + 1; i <= inner -> count; ++i){
+        right -> children[i - middle - 1] = inner -> children[i];
+    }
+    right -> count = inner -> count - middle - 1;
+    inner -> count = middle;
+
+    separator = inner -> keys[middle];
+    return right;
+}
+
+/**
+* Removes the item with the given key. If the key is not in the tree,
+* this function does nothing.
+*/
+template<typename Key, typename Value, typename Compare, typename Alloc>
+void BTree<Key, Value, Compare, Alloc>::remove(const Key& key){
+
+    if(root_ == nullptr || !remove_helper(root_, key)){
+        return;
+    }
+
+    //shrink the tree when the root runs out of keys
+    if(root_ -> leaf){
+        if(root_ -> count == 0){
+            destroyNode(root_);
+            root_ = nullptr;
+            first_ = nullptr;
+        }
+    }
+    else if(root_ -> count == 0){
+        Inner* old_root = static_cast<Inner*>(root_);
+        root_ = old_root -> children[0];
+        destroyNode(old_root);
+    }
+}
+
+/**
+* Removes key from the subtree at node and returns true if it was there.
+* Children left with too few keys are fixed on the way back up; node
+* itself is fixed by its parent.
+*/
+template<typename Key, typename Value, typename Compare, typename Alloc>
+bool BTree<Key, Value, Compare, Alloc>::remove_helper(NodeBase* node, const Key& key){
+
+    if(node -> leaf){
+        Leaf* leaf = static_cast<Leaf*>(node);
+        unsigned index = countLess(leaf, key);
+        if(index == leaf -> count || compare_(key, leaf -> keys[index])){
+            return false;
+        }
+        for(unsigned i = index + 1; i < leaf -> count; ++i){
+            leaf -> keys[i - 1] = leaf -> keys[i];
+            leaf -> values[i - 1] = leaf -> values[i];
+        }
+        --leaf -> count;
+        --size_;
+        return true;
+    }
+
+    Inner* inner = static_cast<Inner*>(node);
+    unsigned index = childIndex(inner, key);
+    if(!remove_helper(inner -> children[index], key)){
+        return false;
+    }
+    if(inner -> children[index] -> count < MIN_KEYS){
+        fixChild(inner, index);
+    }
+    return true;
+}
+
+/**
+* Brings the child at index back up to MIN_KEYS, by borrowing one key
+* from a sibling that can spare it or else by merging with a sibling.
+*/
+template<typename Key, typename Value, typename Compare, typename Alloc>
+void BTree<Key, Value, Compare, Alloc>::fixChild(Inner* parent, unsigned index){
+
+    NodeBase* child = parent -> children[index];
+    NodeBase* left = index > 0 ? parent -> children[index - 1] : nullptr;
+    NodeBase* right = index < parent -> count ? parent -> children[index + 1] : nullptr;
+
+    if(child -> leaf){
+        Leaf* leaf = static_cast<Leaf*>(child);
+
+        //borrow the largest item of the left sibling
+        if(left != nullptr && left -> count > MIN_KEYS){
+            Leaf* from = static_cast<Leaf*>(left);
+            for(unsigned i = leaf -> count; i > 0; --i){
+                leaf -> keys[i] = leaf -> keys[i - 1];
+                leaf -> values[i] = leaf -> values[i - 1];
+            }
+            leaf -> keys[0] = from -> keys[from -> count - 1];
+            leaf -> values[0] = from -> values[from -> count - 1];
+            ++leaf -> count;
+            --from -> count;
+            parent -> keys[index - 1] = leaf -> keys[0];
+        }
+        //borrow the smallest item of the right sibling
+        else if(right != nullptr && right -> count > MIN_KEYS){
+            Leaf* from = static_cast<Leaf*>(right);
+            leaf -> keys[leaf -> count] = from -> keys[0];
+            leaf -> values[leaf -> count] = from -> values[0];
+            ++leaf -> count;
+            for(unsigned i = 1; i < from -> count; ++i){
+                from -> keys[i - 1] = from -> keys[i];
+                from -> values[i - 1] = from -> values[i];
+            }
+            --from -> count;
+            parent -> keys[index] = from -> keys[0];
+        }
+        //merge with a sibling, always folding the right leaf into the left one
+        else{
+            unsigned left_index = left != nullptr ? index - 1 : index;
+            Leaf* into = static_cast<Leaf*>(parent -> children[left_index]);
+            Leaf* from = static_cast<Leaf*>(parent -> children[left_index + 1]);
+            for(unsigned i = 0; i < from -> count; ++i){
+                into -> keys[into -> count + i] = from -> keys[i];
+                into -> values[into -> count + i] = from -> values[i];
+            }
+            into -> count += from -> count;
+            into -> next = from -> next;
+            if(from -> next != nullptr){
+                from -> next -> prev = into;
+            }
+            removeFromInner(parent, left_index);
+            destroyNode(from);
+        }
+        return;
+    }
+
+    Inner* node = static_cast<Inner*>(child);
+
+    //rotate a key through the parent from the left sibling
+    if(left != nullptr && left -> count > MIN_KEYS){
+        Inner* from = static_cast<Inner*>(left);
+        for(unsigned i = node -> count; i > 0; --i){
+            node -> keys[i] = node -> keys[i - 1];
+        }
+        for(unsigned i = node -> count + 1; i > 0; --i){
+            node -> children[i] = node -> children[i - 1];
+        }
+        node -> keys[0] = parent -> keys[index - 1];
+        node -> children[0] = from -> children[from -> count];
+        ++node -> count;
+        parent -> keys[index - 1] = from -> keys[from -> count - 1];
+        --from -> count;
+    }
+    //rotate a key through the parent from the right sibling
+    else if(right != nullptr && right -> count > MIN_KEYS){
+        Inner* from = static_cast<Inner*>(right);
+        node -> keys[node -> count] = parent -> keys[index];
+        node -> children[node -> count + 1] = from -> children[0];
+        ++node -> count;
+        parent -> keys[index] = from -> keys[0];
+        for(unsigned i = 1; i < from -> count; ++i){
+            from -> keys[i - 1] = from -> keys[i];
+        }
+        for(unsigned i = 1; i <= from -> count; ++i){
+            from -> children[i - 1] = from -> children[i];
+        }
+        --from -> count;
+    }
+    //merge with a sibling, pulling the separating key down between them
+    else{
+        unsigned left_index = left != nullptr ? index - 1 : index;
+        Inner* into = static_cast<Inner*>(parent -> children[left_index]);
+        Inner* from = static_cast<Inner*>(parent -> children[left_index + 1]);
+        into -> keys[into -> count] = parent -> keys[left_index];
+        for(unsigned i = 0; i < from -> count; ++i){
+            into -> keys[into -> count + 1 + i] = from -> keys[i];
+        }
+        for(unsigned i = 0; i <= from -> count; ++i){
+            into -> children[into -> count + 1 + i] = from -> children[i];
+        }
+        into -> count += from -> count + 1;
+        removeFromInner(parent, left_index);
+        destroyNode(from);
+    }
+}
+
+/**
+* Removes keys[index] and children[index + 1] from an inner node.
+*/
+template<typename Key, typename Value, typename Compare, typename Alloc>
+void BTree<Key, Value, Compare, Alloc>::removeFromInner(Inner* node, unsigned index){
+    for(unsigned i = index + 1; i < node -> count; ++i){
+        node -> keys[i - 1] = node -> keys[i];
+    }
+    for(unsigned i = index + 2; i <= node -> count; ++i){
+        node -> children[i - 1] = node -> children[i];
+    }
+    --node -> count;
+}
+
+/**
+* Removes every item. Like BinarySearchTree::clear, the nodes are not
+* visited when the allocator can free them all at once and there is
+* nothing to destroy.
+*/
+template<typename Key, typename Value, typename Compare, typename Alloc>
+void BTree<Key, Value, Compare, Alloc>::clear(){
+    bool skip_walk = Alloc::bulk_release &&
+        std::is_trivially_destructible<Key>::value &&
+        std::is_trivially_destructible<Value>::value;
+    if(!skip_walk){
+        clear_helper(root_);
+    }
+    leaf_allocator_.release();
+    inner_allocator_.release();
+    root_ = nullptr;
+    first_ = nullptr;
+    size_ = 0;
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc>
+void BTree<Key, Value, Compare, Alloc>::clear_helper(NodeBase* node){
+    if(node == nullptr){
+        return;
+    }
+    if(!node -> leaf){
+        Inner* inner = static_cast<Inner*>(node);
+        for(unsigned i = 0; i <= inner -> count; ++i){
+            clear_helper(inner -> children[i]);
+        }
+    }
+    destroyNode(node);
+}
+
+/**
+* How many keys in node are less than key.
+*/
+template<typename Key, typename Value, typename Compare, typename Alloc>
+unsigned BTree<Key, Value, Compare, Alloc>::countLess(const NodeBase* node, const Key& key) const{
+    return BTreeKeySearch<Key, Compare>::countLess(keysOf(node), node -> count, key, compare_);
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc>
+const Key* BTree<Key, Value, Compare, Alloc>::keysOf(const NodeBase* node) const{
+    if(node -> leaf){
+        return static_cast<const Leaf*>(node) -> keys;
+    }
+    return static_cast<const Inner*>(node) -> keys;
+}
+
+/**
+* The child of an inner node whose subtree would hold key.
+*/
+template<typename Key, typename Value, typename Compare, typename Alloc>
+unsigned BTree<Key, Value, Compare, Alloc>::childIndex(const Inner* node, const Key& key) const{
+    unsigned index = countLess(node, key);
+    if(index < node -> count && !compare_(key, node -> keys[index])){
+        ++index;
+    }
+    return index;
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc>
+typename BTree<Key, Value, Compare, Alloc>::Leaf*
+BTree<Key, Value, Compare, Alloc>::createLeaf(){
+    void* memory = leaf_allocator_.allocate(sizeof(Leaf), alignof(Leaf));
+    Leaf* leaf;
+    try{
+        leaf = new (memory) Leaf();
+    }
+    catch(...){
+        leaf_allocator_.deallocate(memory);
+        throw;
+    }
+    leaf -> count = 0;
+    leaf -> leaf = true;
+    leaf -> prev = nullptr;
+    leaf -> next = nullptr;
+    return leaf;
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc>
+typename BTree<Key, Value, Compare, Alloc>::Inner*
+BTree<Key, Value, Compare, Alloc>::createInner(){
+    void* memory = inner_allocator_.allocate(sizeof(Inner), alignof(Inner));
+    Inner* inner;
+    try{
+        inner = new (memory) Inner();
+    }
+    catch(...){
+        inner_allocator_.deallocate(memory);
+        throw;
+    }
+    inner -> count = 0;
+    inner -> leaf = false;
+    return inner;
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc>
+void BTree<Key, Value, Compare, Alloc>::destroyNode(NodeBase* node){
+    if(node -> leaf){
+        Leaf* leaf = static_cast<Leaf*>(node);
+        leaf -> ~Leaf();
+        leaf_allocator_.deallocate(leaf);
+    }
+    else{
+        Inner* inner = static_cast<Inner*>(node);
+        inner -> ~Inner();
+        inner_allocator_.deallocate(inner);
+    }
+}
+
+/*
+  --------------------------------------
+  End implementations for the BTree class.
+  --------------------------------------
+*/
+
+#endif
@@ -0,0 +1,239 @@
+#ifndef EYTZINGER_INDEX_H
+#define EYTZINGER_INDEX_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+/**
+* A static search index over a sorted sequence of pairs, meant as a read
+* accelerator for a tree that changes rarely: rebuild it from the tree
+* after a batch of changes and send lookups to the index until the next
+* one. It does not follow changes to the tree on its own.
+*
+* The keys are stored in Eytzinger (BFS) order: the root at position 1
+* and the children of position k at 2k and 2k + 1. A search is then a
+* branch-free loop computing k = 2k + (key at k < target). The 2^d
+* descendants d levels below k sit next to each other, so each step
+* prefetches the cache line holding them and the memory latency of the
+* next few levels overlaps with the comparisons of this one.
+*
+* Results are iterators into a sorted copy of the items.
+*/
+template <typename Key, typename Value, typename Compare = std::less<Key> >
+class EytzingerIndex{
+
+public:
+    typedef typename std::vector<std::pair<const Key, Value> >::const_iterator iterator;
+
+    explicit EytzingerIndex(const Compare& compare = Compare());
+
+    template<typename Tree>
+    void rebuild(const Tree& tree);
+    template<typename InputIt>
+    void rebuild(InputIt first, InputIt last);
+
+    iterator begin() const;
+    iterator end() const;
+    std::size_t size() const;
+    bool empty() const;
+
+    iterator find(const Key& key) const;
+    iterator lower_bound(const Key& key) const;
+    iterator upper_bound(const Key& key) const;
+
+private:
+    // how many levels ahead to prefetch: as many as fit one 64-byte line of keys
+    static const unsigned PREFETCH_LEVELS =
+        sizeof(Key) <= 4 ? 4 : sizeof(Key) <= 8 ? 3 : sizeof(Key) <= 16 ? 2 : 1;
+
+    std::size_t fill(std::size_t rank, std::size_t k);
+    void prefetch(std::size_t k) const;
+    static std::size_t resolve(std::size_t k);
+
+    std::vector<std::pair<const Key, Value> > items_;
+    // position 0 of keys_ and ranks_ is unused so that the root is at 1
+    std::vector<Key> keys_;
+    std::vector<std::uint32_t> ranks_;
+    Compare compare_;
+};
+
+/*
+  ----------------------------------------------------
+  Begin implementations for the EytzingerIndex class.
+  ----------------------------------------------------
+*/
+
+/**
+* Constructor for an empty index.
+*/
+template<typename Key, typename Value, typename Compare>
+EytzingerIndex<Key, Value, Compare>::EytzingerIndex(const Compare& compare) :
+    compare_(compare){
+
+}
+
+/**
+* Rebuilds the index from the contents of a tree, taking its comparator.
+*/
+template<typename Key, typename Value, typename Compare>
+template<typename Tree>
+void EytzingerIndex<Key, Value, Compare>::rebuild(const Tree& tree){
+    compare_ = tree.key_comp();
+    rebuild(tree.begin(), tree.end());
+}
+
+/**
+* Rebuilds the index from [first, last), which must be sorted by the
+* comparator and hold no two equal keys. Ranks are stored in 32 bits, so
+* more than 2^32 items throw std::length_error and leave the index empty.
+*/
+template<typename Key, typename Value, typename Compare>
+template<typename InputIt>
+void EytzingerIndex<Key, Value, Compare>::rebuild(InputIt first, InputIt last){
+    items_.clear();
+    for(; first != last; ++first){
+        items_.push_back(*first);
+    }
+    if(!items_.empty() && items_.size() - 1 > std::numeric_limits<std::uint32_t>::max()){
+        items_.clear();
+        keys_.clear();
+        ranks_.clear();
+        throw std::length_error("EytzingerIndex holds at most 2^32 items");
+    }
+
+    keys_.clear();
+    ranks_.clear();
+    keys_.resize(items_.size() + 1);
+    ranks_.resize(items_.size() + 1);
+    fill(0, 1);
+}
+
+template<typename Key, typename Value, typename Compare>
+typename EytzingerIndex<Key, Value, Compare>::iterator
+EytzingerIndex<Key, Value, Compare>::begin() const{
+    return items_.begin();
+}
+
+template<typename Key, typename Value, typename Compare>
+typename EytzingerIndex<Key, Value, Compare>::iterator
+EytzingerIndex<Key, Value, Compare>::end() const{
+    return items_.end();
+}
+
+template<typename Key, typename Value, typename Compare>
+std::size_t EytzingerIndex<Key, Value, Compare>::size() const{
+    return items_.size();
+}
+
+template<typename Key, typename Value, typename Compare>
+bool EytzingerIndex<Key, Value, Compare>::empty() const{
+    return items_.empty();
+}
+
+/**
+* Returns an iterator to the item with the given key, or end().
+*/
+template<typename Key, typename Value, typename Compare>
+typename EytzingerIndex<Key, Value, Compare>::iterator
+EytzingerIndex<Key, Value, Compare>::find(const Key& key) const{
+    iterator it = lower_bound(key);
+    if(it == end() || compare_(key, it -> first)){
+        return end();
+    }
+    return it;
+}
+
+/**
+* Returns an iterator to the first item whose key is not less than key.
+*/
+template<typename Key, typename Value, typename Compare>
+typename EytzingerIndex<Key, Value, Compare>::iterator
+EytzingerIndex<Key, Value, Compare>::lower_bound(const Key& key) const{
+    const std::size_t n = items_.size();
+    std::size_t k = 1;
+    while(k <= n){
+        prefetch(k);
+        k = 2 * k + static_cast<std::size_t>(compare_(keys_[k], key));
+    }
+    k = resolve(k);
+    return k == 0 ? end() : begin() + ranks_[k];
+}
+
+/**
+* Returns an iterator to the first item whose key is greater than key.
+*/
+template<typename Key, typename Value, typename Compare>
+typename EytzingerIndex<Key, Value, Compare>::iterator
+EytzingerIndex<Key, Value, Compare>::upper_bound(const Key& key) const{
+    const std::size_t n = items_.size();
+    std::size_t k = 1;
+    while(k <= n){
+        prefetch(k);
+        k = 2 * k + static_cast<std::size_t>(!compare_(key, keys_[k]));
+    }
+    k = resolve(k);
+    return k == 0 ? end() : begin() + ranks_[k];
+}
+
+/**
+* Places items_ from rank onwards into the subtree at position k, in
+* order, and returns the next rank to place.
+*/
+template<typename Key, typename Value, typename Compare>
+std::size_t EytzingerIndex<Key, Value, Compare>::fill(std::size_t rank, std::size_t k){
+    if(k < keys_.size()){
+        rank = fill(rank, 2 * k);
+        keys_[k] = items_[rank].first;
+        ranks_[k] = static_cast<std::uint32_t>(rank);
+        ++rank;
+        rank = fill(rank, 2 * k + 1);
+    }
+    return rank;
+}
+
+/**
+* Prefetches the keys PREFETCH_LEVELS levels below k. The address is
+* computed as an integer since it may lie past the end of keys_, which
+* is harmless for a prefetch.
+*/
+template<typename Key, typename Value, typename Compare>
+void EytzingerIndex<Key, Value, Compare>::prefetch(std::size_t k) const{
+#if defined(__GNUC__)
+    std::uintptr_t address = reinterpret_cast<std::uintptr_t>(keys_.data()) +
+                             (k << PREFETCH_LEVELS) * sizeof(Key);
+    __builtin_prefetch(reinterpret_cast<const void*>(address));
+#else
+    (void)k;
+#endif
+}
+
+/**
+* The search runs one level past the leaves. The answer is the last node
+* where it turned left, so dropping the right turns taken after it and
+* then that left turn gives the answer's position, or 0 if the search
+* never turned left.
+*/
+template<typename Key, typename Value, typename Compare>
+std::size_t EytzingerIndex<Key, Value, Compare>::resolve(std::size_t k){
+#if defined(__GNUC__)
+    return k >> (__builtin_ctzll(~static_cast<unsigned long long>(k)) + 1);
+#else
+    while(k & 1){
+        k >>= 1;
+    }
+    return k >> 1;
+#endif
+}
+
+/*
+  --------------------------------------------------
+  End implementations for the EytzingerIndex class.
+  --------------------------------------------------
+*/
+
+#endif
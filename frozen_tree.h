@@ -0,0 +1,318 @@
+#ifndef FROZEN_TREE_H
+#define FROZEN_TREE_H
+
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+/**
+* An immutable, read-optimized copy of a search tree, made by
+* BinarySearchTree::freeze() or directly from a sorted range of
+* unique pairs.
+*
+* The items are kept in one sorted array, so iteration and range scans
+* are sequential reads. Lookups go through a separate index, which is a
+* perfectly balanced search tree over copies of the keys. The index is
+* stored in van Emde Boas order, so every subtree of height h sits in
+* about 2^h consecutive entries. A lookup then costs O(log_B n) cache
+* misses for any cache line size B, while walking the pointer tree
+* costs about one miss per level. Children are 32-bit positions in the
+* index array.
+*/
+template <typename Key, typename Value, typename Compare = std::less<Key> >
+class FrozenTree{
+
+public:
+    typedef typename std::vector<std::pair<const Key, Value> >::const_iterator iterator;
+
+    explicit FrozenTree(const Compare& compare = Compare());
+    template<typename InputIt>
+    FrozenTree(InputIt first, InputIt last, const Compare& compare = Compare());
+
+    iterator begin() const;
+    iterator end() const;
+    std::size_t size() const;
+    bool empty() const;
+
+    iterator find(const Key& key) const;
+    iterator lower_bound(const Key& key) const;
+    iterator upper_bound(const Key& key) const;
+    std::pair<iterator, iterator> range(const Key& lo, const Key& hi) const;
+
+private:
+    static const std::uint32_t NONE = 0xFFFFFFFFu;
+
+    // one entry of the search index
+    struct IndexNode{
+        Key key;
+        std::uint32_t left;
+        std::uint32_t right;
+        std::uint32_t rank;
+    };
+
+    void buildIndex();
+    void layout(std::size_t lo, std::size_t hi, unsigned height, std::vector<std::uint32_t>& position,
+                std::vector<std::pair<std::size_t, std::size_t> >& bounds);
+    static void collectRoots(std::size_t lo, std::size_t hi, unsigned depth,
+                             std::vector<std::pair<std::size_t, std::size_t> >& roots);
+    static std::size_t middle(std::size_t lo, std::size_t hi);
+    std::size_t lowerRank(const Key& key) const;
+    std::size_t upperRank(const Key& key) const;
+
+    std::vector<std::pair<const Key, Value> > items_;
+    std::vector<IndexNode> index_;
+    Compare compare_;
+};
+
+/*
+  ------------------------------------------------
+  Begin implementations for the FrozenTree class.
+  ------------------------------------------------
+*/
+
+/**
+* Constructor for an empty FrozenTree.
+*/
+template<typename Key, typename Value, typename Compare>
+FrozenTree<Key, Value, Compare>::FrozenTree(const Compare& compare) :
+    compare_(compare){
+
+}
+
+/**
+* Builds a FrozenTree from [first, last), which must be sorted by
+* compare and hold no two equal keys (a tree's begin()/end() does).
+*/
+template<typename Key, typename Value, typename Compare>
+template<typename InputIt>
+FrozenTree<Key, Value, Compare>::FrozenTree(InputIt first, InputIt last, const Compare& compare) :
+    compare_(compare){
+    for(; first != last; ++first){
+        items_.push_back(*first);
+    }
+    buildIndex();
+}
+
+template<typename Key, typename Value, typename Compare>
+typename FrozenTree<Key, Value, Compare>::iterator
+FrozenTree<Key, Value, Compare>::begin() const{
+    return items_.begin();
+}
+
+template<typename Key, typename Value, typename Compare>
+typename FrozenTree<Key, Value, Compare>::iterator
+FrozenTree<Key, Value, Compare>::end() const{
+    return items_.end();
+}
+
+template<typename Key, typename Value, typename Compare>
+std::size_t FrozenTree<Key, Value, Compare>::size() const{
+    return items_.size();
+}
+
+template<typename Key, typename Value, typename Compare>
+bool FrozenTree<Key, Value, Compare>::empty() const{
+    return items_.empty();
+}
+
+/**
+* Returns an iterator to the item with the given key, or end().
+*/
+template<typename Key, typename Value, typename Compare>
+typename FrozenTree<Key, Value, Compare>::iterator
+FrozenTree<Key, Value, Compare>::find(const Key& key) const{
+    std::size_t rank = lowerRank(key);
+    if(rank == items_.size() || compare_(key, items_[rank].first)){
+        return end();
+    }
+    return begin() + rank;
+}
+
+/**
+* Returns an iterator to the first item whose key is not less than key.
+*/
+template<typename Key, typename Value, typename Compare>
+typename FrozenTree<Key, Value, Compare>::iterator
+FrozenTree<Key, Value, Compare>::lower_bound(const Key& key) const{
+    return begin() + lowerRank(key);
+}
+
+/**
+* Returns an iterator to the first item whose key is greater than key.
+*/
+template<typename Key, typename Value, typename Compare>
+typename FrozenTree<Key, Value, Compare>::iterator
+FrozenTree<Key, Value, Compare>::upper_bound(const Key& key) const{
+    return begin() + upperRank(key);
+}
+
+/**
+* Returns the items with lo <= key < hi as a pair of iterators.
+*/
+template<typename Key, typename Value, typename Compare>
+std::pair<typename FrozenTree<Key, Value, Compare>::iterator,
+          typename FrozenTree<Key, Value, Compare>::iterator>
+FrozenTree<Key, Value, Compare>::range(const Key& lo, const Key& hi) const{
+    iterator first = lower_bound(lo);
+    if(!compare_(lo, hi)){
+        return std::make_pair(first, first);
+    }
+    return std::make_pair(first, lower_bound(hi));
+}
+
+/**
+* The rank of the first item whose key is not less than key. Like
+* BinarySearchTree::internalFind this makes one comparison per level.
+*/
+template<typename Key, typename Value, typename Compare>
+std::size_t FrozenTree<Key, Value, Compare>::lowerRank(const Key& key) const{
+    std::size_t result = items_.size();
+    std::uint32_t current = index_.empty() ? NONE : 0;
+    while(current != NONE){
+        const IndexNode& node = index_[current];
+        if(compare_(node.key, key)){
+            current = node.right;
+        }
+        else{
+            result = node.rank;
+            current = node.left;
+        }
+    }
+    return result;
+}
+
+/**
+* The rank of the first item whose key is greater than key.
+*/
+template<typename Key, typename Value, typename Compare>
+std::size_t FrozenTree<Key, Value, Compare>::upperRank(const Key& key) const{
+    std::size_t result = items_.size();
+    std::uint32_t current = index_.empty() ? NONE : 0;
+    while(current != NONE){
+        const IndexNode& node = index_[current];
+        if(compare_(key, node.key)){
+            result = node.rank;
+            current = node.left;
+        }
+        else{
+            current = node.right;
+        }
+    }
+    return result;
+}
+
+/**
+* The item at the root of the balanced subtree over ranks [lo, hi).
+*/
+template<typename Key, typename Value, typename Compare>
+std::size_t FrozenTree<Key, Value, Compare>::middle(std::size_t lo, std::size_t hi){
+    return lo + (hi - lo) / 2;
+}
+
+/**
+* Builds the index over items_. The subtree over ranks [lo, hi) has
+* middle(lo, hi) at its root, so a tree of n items has height
+* floor(log2 n) + 1.
+*/
+template<typename Key, typename Value, typename Compare>
+void FrozenTree<Key, Value, Compare>::buildIndex(){
+
+    std::size_t n = items_.size();
+    if(n >= NONE){
+        throw std::length_error("FrozenTree holds at most 2^32 - 2 items");
+    }
+    index_.clear();
+    index_.reserve(n);
+    if(n == 0){
+        return;
+    }
+
+    unsigned height = 0;
+    for(std::size_t s = n; s > 0; s /= 2){
+        ++height;
+    }
+
+    //position[r] is where the node for rank r ended up in the index,
+    //bounds[p] is the range of ranks under the node at position p
+    std::vector<std::uint32_t> position(n);
+    std::vector<std::pair<std::size_t, std::size_t> > bounds;
+    bounds.reserve(n);
+    layout(0, n, height, position, bounds);
+
+    //link every node to its children now that all positions are known
+    for(std::size_t p = 0; p < n; ++p){
+        IndexNode& node = index_[p];
+        std::size_t lo = bounds[p].first;
+        std::size_t hi = bounds[p].second;
+        std::size_t mid = node.rank;
+        if(lo < mid){
+            node.left = position[middle(lo, mid)];
+        }
+        if(mid + 1 < hi){
+            node.right = position[middle(mid + 1, hi)];
+        }
+    }
+}
+
+/**
+* Appends the top height levels of the subtree over ranks [lo, hi) to
+* the index in van Emde Boas order: the top half of the levels first,
+* then each subtree hanging below them, left to right, each laid out
+* the same way.
+*/
+template<typename Key, typename Value, typename Compare>
+void FrozenTree<Key, Value, Compare>::layout(std::size_t lo, std::size_t hi, unsigned height,
+                                            std::vector<std::uint32_t>& position,
+                                            std::vector<std::pair<std::size_t, std::size_t> >& bounds){
+    if(lo >= hi || height == 0){
+        return;
+    }
+    if(height == 1){
+        std::size_t mid = middle(lo, hi);
+        IndexNode node = { items_[mid].first, NONE, NONE, static_cast<std::uint32_t>(mid) };
+        position[mid] = static_cast<std::uint32_t>(index_.size());
+        bounds.push_back(std::make_pair(lo, hi));
+        index_.push_back(node);
+        return;
+    }
+
+    unsigned top = height / 2;
+    unsigned bottom = height - top;
+    layout(lo, hi, top, position, bounds);
+
+    std::vector<std::pair<std::size_t, std::size_t> > roots;
+    collectRoots(lo, hi, top, roots);
+    for(std::size_t i = 0; i < roots.size(); ++i){
+        layout(roots[i].first, roots[i].second, bottom, position, bounds);
+    }
+}
+
+/**
+* Collects the rank ranges of the subtrees exactly depth levels below
+* the root of [lo, hi), left to right.
+*/
+template<typename Key, typename Value, typename Compare>
+void FrozenTree<Key, Value, Compare>::collectRoots(std::size_t lo, std::size_t hi, unsigned depth,
+                                                  std::vector<std::pair<std::size_t, std::size_t> >& roots){
+    if(lo >= hi){
+        return;
+    }
+    if(depth == 0){
+        roots.push_back(std::make_pair(lo, hi));
+        return;
+    }
+    std::size_t mid = middle(lo, hi);
+    collectRoots(lo, mid, depth - 1, roots);
+    collectRoots(mid + 1, hi, depth - 1, roots);
+}
+
+/*
+  ----------------------------------------------
+  End implementations for the FrozenTree class.
+  ----------------------------------------------
+*/
+
+#endif
@@ -0,0 +1,378 @@
+#ifndef INTERVAL_TREE_H
+#define INTERVAL_TREE_H
+
+#include <functional>
+#include <ostream>
+#include <type_traits>
+#include <utility>
+#include "avlbst.h"
+
+/**
+* A closed interval [low, high], with low <= high. Intervals are ordered
+* by low and then by high.
+*/
+template <typename T>
+struct Interval{
+    T low;
+    T high;
+};
+
+template<typename T>
+bool operator<(const Interval<T>& a, const Interval<T>& b){
+    if(a.low < b.low){
+        return true;
+    }
+    if(b.low < a.low){
+        return false;
+    }
+    return a.high < b.high;
+}
+
+template<typename T>
+bool operator==(const Interval<T>& a, const Interval<T>& b){
+    return !(a < b) && !(b < a);
+}
+
+template<typename T>
+std::ostream& operator<<(std::ostream& out, const Interval<T>& interval){
+    return out << '[' << interval.low << ", " << interval.high << ']';
+}
+
+/**
+* A node for an IntervalTree. The key is an interval and the node adds
+* the largest right endpoint found in its subtree.
+*/
+template <typename T, typename Value>
+class IntervalNode : public AVLNode<Interval<T>, Value>{
+
+public:
+
+    // Constructor/destructor.
+    IntervalNode(const Interval<T>& key, const Value& value, IntervalNode<T, Value>* parent);
+    IntervalNode(Interval<T>&& key, Value&& value, IntervalNode<T, Value>* parent);
+    ~IntervalNode();
+
+    // Getter/setter for the largest right endpoint in the subtree.
+    const T& getMaxEnd() const;
+    void setMaxEnd(const T& max_end);
+
+    // Getters for parent, left, and right, hidden the same way AVLNode does.
+    IntervalNode<T, Value>* getParent() const;
+    IntervalNode<T, Value>* getLeft() const;
+    IntervalNode<T, Value>* getRight() const;
+
+protected:
+    T max_end_;
+};
+
+/*
+  -------------------------------------------------
+  Begin implementations for the IntervalNode class.
+  -------------------------------------------------
+*/
+
+/**
+* An explicit constructor for a node that is a subtree of one node.
+*/
+template<class T, class Value>
+IntervalNode<T, Value>::IntervalNode(const Interval<T>& key, const Value& value,
+                                     IntervalNode<T, Value>* parent) :
+    AVLNode<Interval<T>, Value>(key, value, parent),
+    max_end_(key.high){
+
+}
+
+/**
+* An explicit constructor that moves the key and value into the node.
+*/
+template<class T, class Value>
+IntervalNode<T, Value>::IntervalNode(Interval<T>&& key, Value&& value,
+                                     IntervalNode<T, Value>* parent) :
+    AVLNode<Interval<T>, Value>(std::move(key), std::move(value), parent),
+    max_end_(this -> getKey().high){
+
+}
+
+/**
+* A destructor which does nothing.
+*/
+template<class T, class Value>
+IntervalNode<T, Value>::~IntervalNode(){
+
+}
+
+/**
+* A getter for the largest right endpoint in the subtree.
+*/
+template<class T, class Value>
+const T& IntervalNode<T, Value>::getMaxEnd() const{
+    return max_end_;
+}
+
+/**
+* A setter for the largest right endpoint in the subtree.
+*/
+template<class T, class Value>
+void IntervalNode<T, Value>::setMaxEnd(const T& max_end){
+    max_end_ = max_end;
+}
+
+/**
+* Every node in an IntervalTree is an IntervalNode so the cast is always safe.
+*/
+template<class T, class Value>
+IntervalNode<T, Value>* IntervalNode<T, Value>::getParent() const{
+    return static_cast<IntervalNode<T, Value>*>(Node<Interval<T>, Value>::getParent());
+}
+
+/**
+* Hidden for the same reasons as above.
+*/
+template<class T, class Value>
+IntervalNode<T, Value>* IntervalNode<T, Value>::getLeft() const{
+    return static_cast<IntervalNode<T, Value>*>(this -> left_);
+}
+
+/**
+* Hidden for the same reasons as above.
+*/
+template<class T, class Value>
+IntervalNode<T, Value>* IntervalNode<T, Value>::getRight() const{
+    return static_cast<IntervalNode<T, Value>*>(this -> right_);
+}
+
+/*
+  -----------------------------------------------
+  End implementations for the IntervalNode class.
+  -----------------------------------------------
+*/
+
+/**
+* An AVLTree keyed by closed intervals, so the same interval can only be
+* stored once and inserting it again overwrites its value. Every node
+* keeps the largest right endpoint of its subtree, maintained through the
+* augmentation hook of AVLTree, which lets overlap queries skip any
+* subtree that ends before the query starts.
+*
+* The queries report intervals in order to a callback or an output
+* iterator and allocate nothing. They run in O(log n) when nothing
+* overlaps and O(min(n, (k + 1) log n)) for k results.
+*/
+template <class T, class Value, class Alloc = NodePool>
+class IntervalTree : public AVLTree<Interval<T>, Value, std::less<Interval<T> >, Alloc>{
+
+public:
+    typedef BinarySearchTree<Interval<T>, Value, std::less<Interval<T> >, Alloc> Base;
+    typedef typename Base::iterator iterator;
+
+    IntervalTree();
+    virtual ~IntervalTree();
+
+    template<typename Function>
+    void forEachOverlapping(const T& low, const T& high, Function f) const;
+    template<typename Function>
+    void forEachContaining(const T& point, Function f) const;
+    template<typename OutputIt>
+    OutputIt findOverlapping(const T& low, const T& high, OutputIt out) const;
+    bool overlapsAny(const T& low, const T& high) const;
+
+protected:
+    typedef IntervalNode<T, Value> NodeType;
+
+    virtual Node<Interval<T>, Value>* makeNode(Interval<T>&& key, Value&& value, Node<Interval<T>, Value>* parent);
+    virtual void destroyNode(Node<Interval<T>, Value>* current);
+    virtual void updateAugment(AVLNode<Interval<T>, Value>* current);
+    virtual const char* checkNode(Node<Interval<T>, Value>* current, int left_height, int right_height) const;
+    virtual bool trivialNodes() const;
+
+    template<typename Function>
+    void overlapHelper(NodeType* current, const T& low, const T& high, Function& f) const;
+    NodeType* getRoot() const;
+};
+
+/*
+  ---------------------------------------------------
+  Begin implementations for the IntervalTree class.
+  ---------------------------------------------------
+*/
+
+template<class T, class Value, class Alloc>
+IntervalTree<T, Value, Alloc>::IntervalTree(){
+    this -> augmented_ = true;
+}
+
+/**
+* Cleared here for the same reason AVLTree's destructor clears.
+*/
+template<class T, class Value, class Alloc>
+IntervalTree<T, Value, Alloc>::~IntervalTree(){
+    this -> clear();
+}
+
+/**
+* Calls f(item) for every stored interval that shares at least one point
+* with [low, high], in the order of the tree.
+*/
+template<class T, class Value, class Alloc>
+template<typename Function>
+void IntervalTree<T, Value, Alloc>::forEachOverlapping(const T& low, const T& high, Function f) const{
+    auto report = [&f](NodeType* node){
+        f(node -> getItem());
+    };
+    overlapHelper(getRoot(), low, high, report);
+}
+
+/**
+* Calls f(item) for every stored interval that contains point.
+*/
+template<class T, class Value, class Alloc>
+template<typename Function>
+void IntervalTree<T, Value, Alloc>::forEachContaining(const T& point, Function f) const{
+    forEachOverlapping(point, point, f);
+}
+
+/**
+* Writes an iterator to every stored interval that overlaps [low, high]
+* to out, in order, and returns out advanced past the last one.
+*/
+template<class T, class Value, class Alloc>
+template<typename OutputIt>
+OutputIt IntervalTree<T, Value, Alloc>::findOverlapping(const T& low, const T& high, OutputIt out) const{
+    auto report = [this, &out](NodeType* node){
+        *out = this -> makeIterator(node);
+        ++out;
+    };
+    overlapHelper(getRoot(), low, high, report);
+    return out;
+}
+
+/**
+* Returns true if some stored interval overlaps [low, high]. O(log n).
+*/
+template<class T, class Value, class Alloc>
+bool IntervalTree<T, Value, Alloc>::overlapsAny(const T& low, const T& high) const{
+    NodeType* current = getRoot();
+    while(current != nullptr){
+        const Interval<T>& interval = current -> getKey();
+        if(!(interval.high < low) && !(high < interval.low)){
+            return true;
+        }
+        //if some interval on the left reaches low but does not overlap,
+        //it starts after high, and so does everything on the right
+        //since it starts later still, so the left is the only place to look
+        NodeType* left = current -> getLeft();
+        if(left != nullptr && !(left -> getMaxEnd() < low)){
+            current = left;
+        }
+        else{
+            current = current -> getRight();
+        }
+    }
+    return false;
+}
+
+/**
+* Reports the intervals overlapping [low, high] in the subtree at current,
+* in order. A subtree is skipped when its largest right endpoint is below
+* low, and the right side of a node is skipped when the node itself starts
+* after high, since everything there starts later still.
+*/
+template<class T, class Value, class Alloc>
+template<typename Function>
+void IntervalTree<T, Value, Alloc>::overlapHelper(NodeType* current, const T& low, const T& high,
+                                                  Function& f) const{
+    if(current == nullptr || current -> getMaxEnd() < low){
+        return;
+    }
+    overlapHelper(current -> getLeft(), low, high, f);
+
+    const Interval<T>& interval = current -> getKey();
+    if(high < interval.low){
+        return;
+    }
+    if(!(interval.high < low)){
+        f(current);
+    }
+    overlapHelper(current -> getRight(), low, high, f);
+}
+
+/**
+* Creates an IntervalNode, moving the key and value in.
+*/
+template<class T, class Value, class Alloc>
+Node<Interval<T>, Value>* IntervalTree<T, Value, Alloc>::makeNode(Interval<T>&& key, Value&& value,
+                                                                   Node<Interval<T>, Value>* parent){
+    return this -> createNode(std::move(key), std::move(value), static_cast<NodeType*>(parent));
+}
+
+/**
+* Destroys a node as the IntervalNode it really is.
+*/
+template<class T, class Value, class Alloc>
+void IntervalTree<T, Value, Alloc>::destroyNode(Node<Interval<T>, Value>* current){
+    NodeType* node = static_cast<NodeType*>(current);
+    node -> ~NodeType();
+    this -> allocator_.deallocate(node);
+}
+
+/**
+* The largest right endpoint of a subtree is the largest of the node's own
+* and those of its two children.
+*/
+template<class T, class Value, class Alloc>
+void IntervalTree<T, Value, Alloc>::updateAugment(AVLNode<Interval<T>, Value>* current){
+    NodeType* node = static_cast<NodeType*>(current);
+    const T* max_end = &node -> getKey().high;
+    if(node -> getLeft() != nullptr && *max_end < node -> getLeft() -> getMaxEnd()){
+        max_end = &node -> getLeft() -> getMaxEnd();
+    }
+    if(node -> getRight() != nullptr && *max_end < node -> getRight() -> getMaxEnd()){
+        max_end = &node -> getRight() -> getMaxEnd();
+    }
+    node -> setMaxEnd(*max_end);
+}
+
+/**
+* Checks the stored largest endpoint along with the AVL balance.
+*/
+template<class T, class Value, class Alloc>
+const char* IntervalTree<T, Value, Alloc>::checkNode(Node<Interval<T>, Value>* current,
+                                                     int left_height, int right_height) const{
+    NodeType* node = static_cast<NodeType*>(current);
+    const T* max_end = &node -> getKey().high;
+    if(node -> getLeft() != nullptr && *max_end < node -> getLeft() -> getMaxEnd()){
+        max_end = &node -> getLeft() -> getMaxEnd();
+    }
+    if(node -> getRight() != nullptr && *max_end < node -> getRight() -> getMaxEnd()){
+        max_end = &node -> getRight() -> getMaxEnd();
+    }
+    if(*max_end < node -> getMaxEnd() || node -> getMaxEnd() < *max_end){
+        return "a stored largest endpoint is wrong";
+    }
+    return AVLTree<Interval<T>, Value, std::less<Interval<T> >, Alloc>::checkNode(current, left_height, right_height);
+}
+
+/**
+* The largest endpoint stored in every node needs destroying too if T is
+* not trivial. The node types themselves never count as trivial since
+* their destructors are user-provided, so the members are checked.
+*/
+template<class T, class Value, class Alloc>
+bool IntervalTree<T, Value, Alloc>::trivialNodes() const{
+    return std::is_trivially_destructible<std::pair<const Interval<T>, Value> >::value &&
+           std::is_trivially_destructible<T>::value;
+}
+
+template<class T, class Value, class Alloc>
+typename IntervalTree<T, Value, Alloc>::NodeType*
+IntervalTree<T, Value, Alloc>::getRoot() const{
+    return static_cast<NodeType*>(this -> root_);
+}
+
+/*
+  -------------------------------------------------
+  End implementations for the IntervalTree class.
+  -------------------------------------------------
+*/
+
+#endif
@@ -0,0 +1,364 @@
+#ifndef NODE_POOL_H
+#define NODE_POOL_H
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <vector>
+
+/**
+* A slab allocator for the nodes of a single tree. Memory is handed out
+* in fixed-size slots carved from large chunks. A slot given back with
+* deallocate() goes on a freelist and is reused by the next allocate(),
+* and release() gives every chunk back at once so a tree can be torn
+* down in O(chunks) instead of one delete per node.
+*
+* Every slot has the size and alignment of the first allocation, since a
+* tree only ever allocates one kind of node.
+*
+* The chunks live in a reference-counted arena. When nodes move from one
+* tree to another (AVLTree::split, join and the set operations), share()
+* lets the receiving pool keep the giving pool's arena alive, so the moved
+* nodes stay valid whichever tree is released first. Every arena counts
+* the slots handed out from it that still hold a node, in whichever pool,
+* and a pool lets go of a borrowed arena once that count drops to zero.
+* A slot handed back goes on the freelist of the arena it came from.
+*/
+class NodePool{
+
+public:
+    // release() frees every slot without visiting them
+    static const bool bulk_release = true;
+
+    NodePool();
+    ~NodePool();
+
+    void* allocate(std::size_t size, std::size_t align);
+    void deallocate(void* ptr);
+    void release();
+    void share(const NodePool& other);
+    bool exclusive() const;
+
+private:
+    NodePool(const NodePool&);
+    NodePool& operator=(const NodePool&);
+
+    struct Arena;
+
+    void addChunk();
+    Arena* findBorrowed(const void* ptr) const;
+    void dropBorrowed(Arena* arena);
+    void indexBorrowed();
+
+    // a chunk is a header followed by its slots
+    struct Chunk{
+        Chunk* next;
+        char* end;
+    };
+    // a freed slot stores the link to the next free slot
+    struct FreeSlot{
+        FreeSlot* next;
+    };
+    // the chunks of a pool, freed when the last pool referring to them lets go
+    struct Arena{
+        Arena();
+        ~Arena();
+        Chunk* chunks;
+        FreeSlot* free_list;
+        // slots handed out from this arena that still hold a node
+        std::size_t live;
+    };
+    // the slots of one borrowed chunk, for finding the arena a slot is from
+    struct ChunkRange{
+        const char* begin;
+        const char* end;
+        Arena* arena;
+    };
+
+    static const std::size_t FIRST_CHUNK_SLOTS = 32;
+    static const std::size_t MAX_CHUNK_SLOTS = 4096;
+
+    std::shared_ptr<Arena> arena_;
+    // arenas of other pools holding nodes that now belong to this one, by address
+    std::vector<std::shared_ptr<Arena> > borrowed_;
+    // the chunks of the borrowed arenas, by address
+    std::vector<ChunkRange> borrowed_chunks_;
+    char* cursor_;
+    char* end_;
+    std::size_t slot_size_;
+    std::size_t chunk_slots_;
+};
+
+/**
+* A node allocator that goes straight to the heap for every node.
+* This is how the trees allocated before NodePool existed; it cannot
+* release nodes in bulk, so clear() frees them one at a time.
+*/
+class HeapAllocator{
+
+public:
+    static const bool bulk_release = false;
+
+    void* allocate(std::size_t size, std::size_t align);
+    void deallocate(void* ptr);
+    void release();
+    void share(const HeapAllocator& other);
+    bool exclusive() const;
+};
+
+/*
+  -------------------------------------------
+  Begin implementations for the NodePool class.
+  -------------------------------------------
+*/
+
+inline NodePool::Arena::Arena() :
+    chunks(nullptr),
+    free_list(nullptr),
+    live(0){
+}
+
+inline NodePool::Arena::~Arena(){
+    while(chunks != nullptr){
+        Chunk* next = chunks -> next;
+        ::operator delete(chunks);
+        chunks = next;
+    }
+}
+
+inline NodePool::NodePool() :
+    cursor_(nullptr),
+    end_(nullptr),
+    slot_size_(0),
+    chunk_slots_(FIRST_CHUNK_SLOTS){
+}
+
+inline NodePool::~NodePool(){
+    release();
+}
+
+/**
+* Returns a slot of at least size bytes, preferring a previously freed one.
+*/
+inline void* NodePool::allocate(std::size_t size, std::size_t align){
+
+    //the first allocation fixes the slot size, rounded up to the node's
+    //alignment so that slots packed back to back all stay aligned
+    if(slot_size_ == 0){
+        if(align < alignof(FreeSlot)){
+            align = alignof(FreeSlot);
+        }
+        std::size_t slot = size < sizeof(FreeSlot) ? sizeof(FreeSlot) : size;
+        slot_size_ = (slot + align - 1) / align * align;
+    }
+
+    if(arena_ && arena_ -> free_list != nullptr){
+        FreeSlot* slot = arena_ -> free_list;
+        arena_ -> free_list = slot -> next;
+        ++arena_ -> live;
+        return slot;
+    }
+
+    if(cursor_ == end_){
+        addChunk();
+    }
+    void* slot = cursor_;
+    cursor_ += slot_size_;
+    ++arena_ -> live;
+    return slot;
+}
+
+/**
+* Puts a slot on the freelist of the arena it came from. The memory stays
+* owned by the arena. A borrowed arena none of whose slots hold a node
+* any more is let go.
+*/
+inline void NodePool::deallocate(void* ptr){
+    if(ptr == nullptr){
+        return;
+    }
+    Arena* arena = arena_.get();
+    if(!borrowed_chunks_.empty()){
+        Arena* borrowed = findBorrowed(ptr);
+        if(borrowed != nullptr){
+            arena = borrowed;
+        }
+    }
+    FreeSlot* slot = static_cast<FreeSlot*>(ptr);
+    slot -> next = arena -> free_list;
+    arena -> free_list = slot;
+    if(--arena -> live == 0 && arena != arena_.get()){
+        dropBorrowed(arena);
+    }
+}
+
+/**
+* Frees every chunk, unless another pool still shares them. Anything still
+* living in the pool must already have been destroyed, or be trivially
+* destructible with the pool exclusive(), since otherwise the counts of
+* the shared arenas would never drop to zero.
+*/
+inline void NodePool::release(){
+    arena_.reset();
+    borrowed_.clear();
+    borrowed_chunks_.clear();
+    cursor_ = nullptr;
+    end_ = nullptr;
+    chunk_slots_ = FIRST_CHUNK_SLOTS;
+}
+
+/**
+* Keeps every arena other holds nodes in alive for as long as this pool
+* holds nodes in it too, so that nodes allocated by other can be moved
+* into this pool's tree and handed back to this pool. Arenas whose nodes
+* have all been freed elsewhere since the last call are let go here.
+* O(a log a + c log c) for a arenas and c chunks borrowed.
+*/
+inline void NodePool::share(const NodePool& other){
+    if(&other == this){
+        return;
+    }
+    std::vector<std::shared_ptr<Arena> > arenas(other.borrowed_);
+    if(other.arena_){
+        arenas.push_back(other.arena_);
+    }
+    for(std::size_t i = 0; i < arenas.size(); ++i){
+        if(arenas[i] != arena_ && arenas[i] -> live > 0){
+            borrowed_.push_back(arenas[i]);
+        }
+    }
+
+    //keep one entry per arena, in address order, dropping the empty ones
+    std::sort(borrowed_.begin(), borrowed_.end());
+    borrowed_.erase(std::unique(borrowed_.begin(), borrowed_.end()), borrowed_.end());
+    std::size_t kept = 0;
+    for(std::size_t i = 0; i < borrowed_.size(); ++i){
+        if(borrowed_[i] -> live > 0){
+            borrowed_[kept++].swap(borrowed_[i]);
+        }
+    }
+    borrowed_.resize(kept);
+    indexBorrowed();
+}
+
+/**
+* True if no other pool shares memory with this one. Only then can
+* release() free nodes that were never handed back with deallocate().
+*/
+inline bool NodePool::exclusive() const{
+    return borrowed_.empty() && (!arena_ || arena_.use_count() == 1);
+}
+
+/**
+* Allocates a new chunk, each one twice as big as the last up to
+* MAX_CHUNK_SLOTS, and points the bump cursor at its first slot.
+*/
+inline void NodePool::addChunk(){
+    const std::size_t align = alignof(std::max_align_t);
+    std::size_t header = (sizeof(Chunk) + align - 1) / align * align;
+
+    if(!arena_){
+        arena_ = std::make_shared<Arena>();
+    }
+    char* memory = static_cast<char*>(::operator new(header + slot_size_ * chunk_slots_));
+    Chunk* chunk = reinterpret_cast<Chunk*>(memory);
+    chunk -> next = arena_ -> chunks;
+    arena_ -> chunks = chunk;
+
+    cursor_ = memory + header;
+    end_ = cursor_ + slot_size_ * chunk_slots_;
+    chunk -> end = end_;
+
+    if(chunk_slots_ < MAX_CHUNK_SLOTS){
+        chunk_slots_ *= 2;
+    }
+}
+
+/**
+* The borrowed arena ptr lies in, or NULL if it is in this pool's own.
+*/
+inline NodePool::Arena* NodePool::findBorrowed(const void* ptr) const{
+    const char* address = static_cast<const char*>(ptr);
+    std::vector<ChunkRange>::const_iterator it =
+        std::upper_bound(borrowed_chunks_.begin(), borrowed_chunks_.end(), address,
+                         [](const char* a, const ChunkRange& range){
+                             return a < range.begin;
+                         });
+    if(it == borrowed_chunks_.begin()){
+        return nullptr;
+    }
+    --it;
+    return address < it -> end ? it -> arena : nullptr;
+}
+
+/**
+* Lets go of a borrowed arena, which frees it unless another pool still
+* refers to it.
+*/
+inline void NodePool::dropBorrowed(Arena* arena){
+    for(std::size_t i = 0; i < borrowed_.size(); ++i){
+        if(borrowed_[i].get() == arena){
+            borrowed_.erase(borrowed_.begin() + i);
+            break;
+        }
+    }
+    indexBorrowed();
+}
+
+/**
+* Rebuilds borrowed_chunks_ from the chunks of the borrowed arenas.
+*/
+inline void NodePool::indexBorrowed(){
+    const std::size_t align = alignof(std::max_align_t);
+    std::size_t header = (sizeof(Chunk) + align - 1) / align * align;
+
+    borrowed_chunks_.clear();
+    for(std::size_t i = 0; i < borrowed_.size(); ++i){
+        for(Chunk* chunk = borrowed_[i] -> chunks; chunk != nullptr; chunk = chunk -> next){
+            ChunkRange range = { reinterpret_cast<char*>(chunk) + header, chunk -> end, borrowed_[i].get() };
+            borrowed_chunks_.push_back(range);
+        }
+    }
+    std::sort(borrowed_chunks_.begin(), borrowed_chunks_.end(),
+              [](const ChunkRange& a, const ChunkRange& b){
+                  return a.begin < b.begin;
+              });
+}
+
+/*
+  -----------------------------------------
+  End implementations for the NodePool class.
+  -----------------------------------------
+*/
+
+inline void* HeapAllocator::allocate(std::size_t size, std::size_t /*align*/){
+    return ::operator new(size);
+}
+
+inline void HeapAllocator::deallocate(void* ptr){
+    ::operator delete(ptr);
+}
+
+/**
+* Nothing to do, every node has already been handed back by deallocate().
+*/
+inline void HeapAllocator::release(){
+
+}
+
+/**
+* Nothing to do, any heap node can be handed to any HeapAllocator.
+*/
+inline void HeapAllocator::share(const HeapAllocator& /*other*/){
+
+}
+
+/**
+* Nothing is ever shared.
+*/
+inline bool HeapAllocator::exclusive() const{
+    return true;
+}
+
+#endif
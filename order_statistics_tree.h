@@ -0,0 +1,291 @@
+#ifndef ORDER_STATISTICS_TREE_H
+#define ORDER_STATISTICS_TREE_H
+
+#include <cstddef>
+#include "avlbst.h"
+
+/**
+* A node for an OrderStatisticsTree, which adds the number of nodes in
+* its subtree (itself included) to an AVLNode.
+*/
+template <typename Key, typename Value>
+class OSNode : public AVLNode<Key, Value>{
+
+public:
+
+    // Constructor/destructor.
+    OSNode(const Key& key, const Value& value, OSNode<Key, Value>* parent);
+    OSNode(Key&& key, Value&& value, OSNode<Key, Value>* parent);
+    ~OSNode();
+
+    // Getter/setter for the size of the node's subtree.
+    std::size_t getSize() const;
+    void setSize(std::size_t size);
+
+    // Getters for parent, left, and right, hidden the same way AVLNode does.
+    OSNode<Key, Value>* getParent() const;
+    OSNode<Key, Value>* getLeft() const;
+    OSNode<Key, Value>* getRight() const;
+
+    static std::size_t sizeOf(const OSNode<Key, Value>* node);
+
+protected:
+    std::size_t size_;
+};
+
+/*
+  -------------------------------------------------
+  Begin implementations for the OSNode class.
+  -------------------------------------------------
+*/
+
+/**
+* An explicit constructor for a node that is a subtree of one node.
+*/
+template<class Key, class Value>
+OSNode<Key, Value>::OSNode(const Key& key, const Value& value, OSNode<Key, Value>* parent) :
+    AVLNode<Key, Value>(key, value, parent),
+    size_(1){
+
+}
+
+/**
+* An explicit constructor that moves the key and value into the node.
+*/
+template<class Key, class Value>
+OSNode<Key, Value>::OSNode(Key&& key, Value&& value, OSNode<Key, Value>* parent) :
+    AVLNode<Key, Value>(std::move(key), std::move(value), parent),
+    size_(1){
+
+}
+
+/**
+* A destructor which does nothing.
+*/
+template<class Key, class Value>
+OSNode<Key, Value>::~OSNode(){
+
+}
+
+/**
+* A getter for the number of nodes in the subtree.
+*/
+template<class Key, class Value>
+std::size_t OSNode<Key, Value>::getSize() const{
+    return size_;
+}
+
+/**
+* A setter for the number of nodes in the subtree.
+*/
+template<class Key, class Value>
+void OSNode<Key, Value>::setSize(std::size_t size){
+    size_ = size;
+}
+
+/**
+* The size of the subtree at node, which is 0 for NULL.
+*/
+template<class Key, class Value>
+std::size_t OSNode<Key, Value>::sizeOf(const OSNode<Key, Value>* node){
+    return node == nullptr ? 0 : node -> size_;
+}
+
+/**
+* Every node in an OrderStatisticsTree is an OSNode so the cast is always safe.
+*/
+template<class Key, class Value>
+OSNode<Key, Value>* OSNode<Key, Value>::getParent() const{
+    return static_cast<OSNode<Key, Value>*>(Node<Key, Value>::getParent());
+}
+
+/**
+* Hidden for the same reasons as above.
+*/
+template<class Key, class Value>
+OSNode<Key, Value>* OSNode<Key, Value>::getLeft() const{
+    return static_cast<OSNode<Key, Value>*>(this -> left_);
+}
+
+/**
+* Hidden for the same reasons as above.
+*/
+template<class Key, class Value>
+OSNode<Key, Value>* OSNode<Key, Value>::getRight() const{
+    return static_cast<OSNode<Key, Value>*>(this -> right_);
+}
+
+/*
+  -----------------------------------------------
+  End implementations for the OSNode class.
+  -----------------------------------------------
+*/
+
+/**
+* An AVLTree that also keeps the size of every subtree, kept up to date
+* through the augmentation hook of AVLTree by inserts, removes, rotations,
+* bulk builds, split/join and the set operations. That gives size() in
+* O(1) and select, rank and countRange in O(log n).
+*/
+template <class Key, class Value, class Compare = std::less<Key>, class Alloc = NodePool>
+class OrderStatisticsTree : public AVLTree<Key, Value, Compare, Alloc>{
+
+public:
+    typedef typename BinarySearchTree<Key, Value, Compare, Alloc>::iterator iterator;
+
+    explicit OrderStatisticsTree(const Compare& compare = Compare());
+    virtual ~OrderStatisticsTree();
+
+    std::size_t size() const;
+    iterator select(std::size_t k) const;
+    std::size_t rank(const Key& key) const;
+    std::size_t countRange(const Key& lo, const Key& hi) const;
+
+protected:
+    virtual Node<Key, Value>* makeNode(Key&& key, Value&& value, Node<Key, Value>* parent);
+    virtual void destroyNode(Node<Key, Value>* current);
+    virtual void updateAugment(AVLNode<Key, Value>* current);
+    virtual const char* checkNode(Node<Key, Value>* current, int left_height, int right_height) const;
+
+    OSNode<Key, Value>* getRoot() const;
+};
+
+/*
+  ----------------------------------------------------------
+  Begin implementations for the OrderStatisticsTree class.
+  ----------------------------------------------------------
+*/
+
+template<class Key, class Value, class Compare, class Alloc>
+OrderStatisticsTree<Key, Value, Compare, Alloc>::OrderStatisticsTree(const Compare& compare) :
+    AVLTree<Key, Value, Compare, Alloc>(compare){
+    this -> augmented_ = true;
+}
+
+/**
+* Cleared here for the same reason AVLTree's destructor clears.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+OrderStatisticsTree<Key, Value, Compare, Alloc>::~OrderStatisticsTree(){
+    this -> clear();
+}
+
+/**
+* Returns the number of items in the tree.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+std::size_t OrderStatisticsTree<Key, Value, Compare, Alloc>::size() const{
+    return OSNode<Key, Value>::sizeOf(getRoot());
+}
+
+/**
+* Returns an iterator to the item with k smaller keys in the tree (the
+* smallest is k = 0), or end() if k >= size().
+*/
+template<class Key, class Value, class Compare, class Alloc>
+typename OrderStatisticsTree<Key, Value, Compare, Alloc>::iterator
+OrderStatisticsTree<Key, Value, Compare, Alloc>::select(std::size_t k) const{
+    OSNode<Key, Value>* current = getRoot();
+    while(current != nullptr){
+        std::size_t left_size = OSNode<Key, Value>::sizeOf(current -> getLeft());
+        if(k < left_size){
+            current = current -> getLeft();
+        }
+        else if(k == left_size){
+            break;
+        }
+        else{
+            k -= left_size + 1;
+            current = current -> getRight();
+        }
+    }
+    return this -> makeIterator(current);
+}
+
+/**
+* Returns the number of keys in the tree that are less than key, whether
+* or not key itself is in the tree.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+std::size_t OrderStatisticsTree<Key, Value, Compare, Alloc>::rank(const Key& key) const{
+    std::size_t result = 0;
+    OSNode<Key, Value>* current = getRoot();
+    while(current != nullptr){
+        if(this -> compare_(current -> getKey(), key)){
+            result += OSNode<Key, Value>::sizeOf(current -> getLeft()) + 1;
+            current = current -> getRight();
+        }
+        else{
+            current = current -> getLeft();
+        }
+    }
+    return result;
+}
+
+/**
+* Returns the number of items with lo <= key < hi.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+std::size_t OrderStatisticsTree<Key, Value, Compare, Alloc>::countRange(const Key& lo, const Key& hi) const{
+    if(!this -> compare_(lo, hi)){
+        return 0;
+    }
+    return rank(hi) - rank(lo);
+}
+
+/**
+* Creates an OSNode, moving the key and value in.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+Node<Key, Value>* OrderStatisticsTree<Key, Value, Compare, Alloc>::makeNode(Key&& key, Value&& value,
+                                                                  Node<Key, Value>* parent){
+    return this -> createNode(std::move(key), std::move(value),
+                              static_cast<OSNode<Key, Value>*>(parent));
+}
+
+/**
+* Destroys a node as the OSNode it really is.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+void OrderStatisticsTree<Key, Value, Compare, Alloc>::destroyNode(Node<Key, Value>* current){
+    OSNode<Key, Value>* node = static_cast<OSNode<Key, Value>*>(current);
+    node -> ~OSNode();
+    this -> allocator_.deallocate(node);
+}
+
+/**
+* The size of a subtree is the sizes of its two children plus one.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+void OrderStatisticsTree<Key, Value, Compare, Alloc>::updateAugment(AVLNode<Key, Value>* current){
+    OSNode<Key, Value>* node = static_cast<OSNode<Key, Value>*>(current);
+    node -> setSize(OSNode<Key, Value>::sizeOf(node -> getLeft()) +
+                    OSNode<Key, Value>::sizeOf(node -> getRight()) + 1);
+}
+
+/**
+* Checks the stored size along with the AVL balance.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+const char* OrderStatisticsTree<Key, Value, Compare, Alloc>::checkNode(Node<Key, Value>* current,
+                                                            int left_height, int right_height) const{
+    OSNode<Key, Value>* node = static_cast<OSNode<Key, Value>*>(current);
+    if(node -> getSize() != OSNode<Key, Value>::sizeOf(node -> getLeft()) +
+                            OSNode<Key, Value>::sizeOf(node -> getRight()) + 1){
+        return "a stored subtree size is wrong";
+    }
+    return AVLTree<Key, Value, Compare, Alloc>::checkNode(current, left_height, right_height);
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+OSNode<Key, Value>* OrderStatisticsTree<Key, Value, Compare, Alloc>::getRoot() const{
+    return static_cast<OSNode<Key, Value>*>(this -> root_);
+}
+
+/*
+  --------------------------------------------------------
+  End implementations for the OrderStatisticsTree class.
+  --------------------------------------------------------
+*/
+
+#endif
@@ -0,0 +1,240 @@
+#ifndef THREADED_TREE_H
+#define THREADED_TREE_H
+
+#include "avlbst.h"
+
+/**
+* A node for a ThreadedAVLTree, which adds links to the nodes before and
+* after it in key order to an AVLNode.
+*/
+template <typename Key, typename Value>
+class ThreadedNode : public AVLNode<Key, Value>{
+
+public:
+
+    // Constructor/destructor.
+    ThreadedNode(const Key& key, const Value& value, ThreadedNode<Key, Value>* parent);
+    ThreadedNode(Key&& key, Value&& value, ThreadedNode<Key, Value>* parent);
+    ~ThreadedNode();
+
+    // Getters/setters for the in-order links.
+    ThreadedNode<Key, Value>* getNext() const;
+    ThreadedNode<Key, Value>* getPrev() const;
+    void setNext(ThreadedNode<Key, Value>* next);
+    void setPrev(ThreadedNode<Key, Value>* prev);
+
+    // Getters for parent, left, and right, hidden the same way AVLNode does.
+    ThreadedNode<Key, Value>* getParent() const;
+    ThreadedNode<Key, Value>* getLeft() const;
+    ThreadedNode<Key, Value>* getRight() const;
+
+protected:
+    ThreadedNode<Key, Value>* next_;
+    ThreadedNode<Key, Value>* prev_;
+};
+
+/*
+  -------------------------------------------------
+  Begin implementations for the ThreadedNode class.
+  -------------------------------------------------
+*/
+
+/**
+* An explicit constructor for a node that is a subtree of one node.
+*/
+template<class Key, class Value>
+ThreadedNode<Key, Value>::ThreadedNode(const Key& key, const Value& value, ThreadedNode<Key, Value>* parent) :
+    AVLNode<Key, Value>(key, value, parent),
+    next_(nullptr),
+    prev_(nullptr){
+
+}
+
+/**
+* An explicit constructor that moves the key and value into the node.
+*/
+template<class Key, class Value>
+ThreadedNode<Key, Value>::ThreadedNode(Key&& key, Value&& value, ThreadedNode<Key, Value>* parent) :
+    AVLNode<Key, Value>(std::move(key), std::move(value), parent),
+    next_(nullptr),
+    prev_(nullptr){
+
+}
+
+/**
+* A destructor which does nothing.
+*/
+template<class Key, class Value>
+ThreadedNode<Key, Value>::~ThreadedNode(){
+
+}
+
+/**
+* A getter for the node after this one in key order.
+*/
+template<class Key, class Value>
+ThreadedNode<Key, Value>* ThreadedNode<Key, Value>::getNext() const{
+    return next_;
+}
+
+/**
+* A getter for the node before this one in key order.
+*/
+template<class Key, class Value>
+ThreadedNode<Key, Value>* ThreadedNode<Key, Value>::getPrev() const{
+    return prev_;
+}
+
+/**
+* A setter for the node after this one in key order.
+*/
+template<class Key, class Value>
+void ThreadedNode<Key, Value>::setNext(ThreadedNode<Key, Value>* next){
+    next_ = next;
+}
+
+/**
+* A setter for the node before this one in key order.
+*/
+template<class Key, class Value>
+void ThreadedNode<Key, Value>::setPrev(ThreadedNode<Key, Value>* prev){
+    prev_ = prev;
+}
+
+/**
+* Every node in a ThreadedAVLTree is a ThreadedNode so the cast is always safe.
+*/
+template<class Key, class Value>
+ThreadedNode<Key, Value>* ThreadedNode<Key, Value>::getParent() const{
+    return static_cast<ThreadedNode<Key, Value>*>(Node<Key, Value>::getParent());
+}
+
+/**
+* Hidden for the same reasons as above.
+*/
+template<class Key, class Value>
+ThreadedNode<Key, Value>* ThreadedNode<Key, Value>::getLeft() const{
+    return static_cast<ThreadedNode<Key, Value>*>(this -> left_);
+}
+
+/**
+* Hidden for the same reasons as above.
+*/
+template<class Key, class Value>
+ThreadedNode<Key, Value>* ThreadedNode<Key, Value>::getRight() const{
+    return static_cast<ThreadedNode<Key, Value>*>(this -> right_);
+}
+
+/*
+  -----------------------------------------------
+  End implementations for the ThreadedNode class.
+  -----------------------------------------------
+*/
+
+/**
+* An AVLTree whose nodes are also linked to their neighbours in key
+* order, so that moving an iterator either way is one pointer load
+* instead of a walk up or down the tree. The links cost two pointers per
+* node, so this pays off when the tree mostly stays in cache; a scan of a
+* tree much bigger than the cache is bound by memory traffic, and there
+* the bigger nodes make it slower than a plain AVLTree.
+*
+* The tree keeps the links up to date itself:
+* - insert and remove relink in O(1), and rotations and nodeSwap never
+*   change the order of the nodes, so they leave the links alone;
+* - split, join and eraseRange relink the nodes at the seams in O(log n);
+* - everything that rebuilds the tree wholesale (assignSorted, a large
+*   insertBatch and the set operations) relinks the whole tree in one
+*   O(n) walk afterwards.
+*/
+template <class Key, class Value, class Compare = std::less<Key>, class Alloc = NodePool>
+class ThreadedAVLTree : public AVLTree<Key, Value, Compare, Alloc>{
+
+public:
+    explicit ThreadedAVLTree(const Compare& compare = Compare());
+    virtual ~ThreadedAVLTree();
+
+protected:
+    virtual Node<Key, Value>* makeNode(Key&& key, Value&& value, Node<Key, Value>* parent);
+    virtual void destroyNode(Node<Key, Value>* current);
+
+    virtual Node<Key, Value>* nextNode(Node<Key, Value>* current) const;
+    virtual Node<Key, Value>* prevNode(Node<Key, Value>* current) const;
+    virtual void threadNodes(Node<Key, Value>* prev, Node<Key, Value>* next);
+};
+
+/*
+  ------------------------------------------------------
+  Begin implementations for the ThreadedAVLTree class.
+  ------------------------------------------------------
+*/
+
+/**
+* Constructor that passes the comparison object to the AVLTree.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+ThreadedAVLTree<Key, Value, Compare, Alloc>::ThreadedAVLTree(const Compare& compare) :
+    AVLTree<Key, Value, Compare, Alloc>(compare){
+    this -> threaded_ = true;
+}
+
+/**
+* Cleared here for the same reason AVLTree's destructor clears.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+ThreadedAVLTree<Key, Value, Compare, Alloc>::~ThreadedAVLTree(){
+    this -> clear();
+}
+
+/**
+* Creates a ThreadedNode, moving the key and value in. The tree links it
+* to its neighbours once it knows where it goes.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+Node<Key, Value>* ThreadedAVLTree<Key, Value, Compare, Alloc>::makeNode(Key&& key, Value&& value,
+                                                              Node<Key, Value>* parent){
+    return this -> createNode(std::move(key), std::move(value), static_cast<ThreadedNode<Key, Value>*>(parent));
+}
+
+/**
+* Destroys a node as the ThreadedNode it really is.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+void ThreadedAVLTree<Key, Value, Compare, Alloc>::destroyNode(Node<Key, Value>* current){
+    ThreadedNode<Key, Value>* node = static_cast<ThreadedNode<Key, Value>*>(current);
+    node -> ~ThreadedNode();
+    this -> allocator_.deallocate(node);
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+Node<Key, Value>* ThreadedAVLTree<Key, Value, Compare, Alloc>::nextNode(Node<Key, Value>* current) const{
+    return static_cast<ThreadedNode<Key, Value>*>(current) -> getNext();
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+Node<Key, Value>* ThreadedAVLTree<Key, Value, Compare, Alloc>::prevNode(Node<Key, Value>* current) const{
+    return static_cast<ThreadedNode<Key, Value>*>(current) -> getPrev();
+}
+
+/**
+* Makes next follow prev. Either may be NULL.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+void ThreadedAVLTree<Key, Value, Compare, Alloc>::threadNodes(Node<Key, Value>* prev, Node<Key, Value>* next){
+    ThreadedNode<Key, Value>* before = static_cast<ThreadedNode<Key, Value>*>(prev);
+    ThreadedNode<Key, Value>* after = static_cast<ThreadedNode<Key, Value>*>(next);
+    if(before != nullptr){
+        before -> setNext(after);
+    }
+    if(after != nullptr){
+        after -> setPrev(before);
+    }
+}
+
+/*
+  ----------------------------------------------------
+  End implementations for the ThreadedAVLTree class.
+  ----------------------------------------------------
+*/
+
+#endif